@@ -1,8 +1,19 @@
 //
 // Created by lyk on 24-4-11.
 //
+// usage: bench [max_size] [output_prefix]
+//   sweeps sizes from 1e2 up to max_size (default 1e6, accepts 1e8) for int,
+//   std::string and a 128 byte struct, and renders every result through
+//   nanobench's json and csv templates into <output_prefix>.json / .csv
+//
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <nanobench.h>
 
@@ -11,96 +22,271 @@
 using namespace ankerl;
 using namespace pycontainer;
 
-int main() {
-    const size_t num = 10000;
-
-    std::vector v(num, 1);
-    pyvec<int>  pv(v.begin(), v.end());
-    std::vector sv(num, std::make_shared<int>(1));
-
-    nanobench::Bench()
-        .minEpochIterations(3000)
-        .run(
-            "vector::push_back",
-            [num]() {
-                std::vector<int> v;
-                v.reserve(num);
-                for (int i = 0; i < num; ++i) { v.push_back(i); }
-                nanobench::doNotOptimizeAway(v);
-            }
-        )
-        .run(
-            "pyvec ::push_back",
-            [num]() {
-                pyvec<int> v{};
-                v.reserve(num);
-                for (int i = 0; i < num; ++i) { v.push_back(i); }
+namespace {
+
+struct big {
+    std::array<uint64_t, 16> payload{};
+
+    friend bool operator<(const big& a, const big& b) { return a.payload[0] < b.payload[0]; }
+    friend bool operator==(const big& a, const big& b) { return a.payload == b.payload; }
+};
+
+template<typename T>
+T make_value(uint64_t x);
+
+template<>
+int make_value<int>(const uint64_t x) {
+    return static_cast<int>(x & 0x7fffffff);
+}
+
+template<>
+std::string make_value<std::string>(const uint64_t x) {
+    // zero padded past the small string buffer at every index, which also keeps the sorted
+    // and reversed inputs in order as strings
+    const auto digits = std::to_string(x);
+    return "item-" + std::string(20 - digits.size(), '0') + digits;
+}
+
+template<>
+big make_value<big>(const uint64_t x) {
+    big ans;
+    for (size_t i = 0; i < ans.payload.size(); ++i) { ans.payload[i] = x + i; }
+    return ans;
+}
+
+uint64_t key(const int x) { return static_cast<uint64_t>(x); }
+uint64_t key(const std::string& x) { return x.size() + static_cast<unsigned char>(x.back()); }
+uint64_t key(const big& x) { return x.payload[0]; }
+
+enum class order { random, sorted, reversed };
+
+template<typename T>
+std::vector<T> make_data(const size_t n, const order kind) {
+    nanobench::Rng rng(42);
+    std::vector<T> ans;
+    ans.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        ans.push_back(make_value<T>(kind == order::random ? rng() >> 1 : i));
+    }
+    if (kind == order::reversed) { std::reverse(ans.begin(), ans.end()); }
+    return ans;
+}
+
+// keeps the whole sweep inside a few GB for the large element type
+constexpr size_t memory_budget = size_t(1) << 31;
+// front and middle edits per measured iteration, so big sizes stay affordable
+constexpr size_t edit_ops = 64;
+
+class suite {
+public:
+    explicit suite(const size_t max_size) : _max_size(max_size) {}
+
+    template<typename T>
+    void run(const std::string& type_name) {
+        const size_t limit = std::min(_max_size, memory_budget / (4 * sizeof(T)));
+        for (size_t n = 100; n <= limit; n *= 10) {
+            push_back<T>(type_name, n);
+            copy<T>(type_name, n);
+            edits<T>(type_name, n);
+            slices<T>(type_name, n);
+            sort<T>(type_name, n);
+            scan<T>(type_name, n);
+        }
+    }
+
+    void render(const std::string& prefix) {
+        std::ofstream json(prefix + ".json");
+        std::ofstream csv(prefix + ".csv");
+        json << "[\n";
+        for (size_t i = 0; i < _benches.size(); ++i) {
+            if (i != 0) { json << ",\n"; }
+            _benches[i].render(nanobench::templates::json(), json);
+            // every bench renders its own csv header, keep only the first
+            std::ostringstream rows;
+            _benches[i].render(nanobench::templates::csv(), rows);
+            const auto text = rows.str();
+            csv << (i == 0 ? text : text.substr(std::min(text.find('\n') + 1, text.size())));
+        }
+        json << "]\n";
+    }
+
+private:
+    size_t                        _max_size;
+    std::vector<nanobench::Bench> _benches;
+
+    nanobench::Bench& bench(const std::string& title, const size_t n, const size_t batch) {
+        auto& ans = _benches.emplace_back();
+        ans.title(title + " n=" + std::to_string(n)).relative(true).batch(batch).complexityN(n);
+        if (n >= 1000000) { ans.epochs(3); }
+        return ans;
+    }
+
+    template<typename T>
+    void push_back(const std::string& type_name, const size_t n) {
+        const auto data = make_data<T>(n, order::random);
+        bench("push_back<" + type_name + ">", n, n)
+            .run(
+                "vector",
+                [&] {
+                    std::vector<T> v;
+                    for (const auto& x : data) { v.push_back(x); }
+                    nanobench::doNotOptimizeAway(v);
+                }
+            )
+            .run("pyvec", [&] {
+                pyvec<T> v;
+                for (const auto& x : data) { v.push_back(x); }
                 nanobench::doNotOptimizeAway(v);
-            }
-        )
-        // deepcopy
-        .run(
-            "vector::deepcopy",
-            [&]() {
-                std::vector<int> v2(v.begin(), v.end());
-                nanobench::doNotOptimizeAway(v2);
-            }
-        )
-        .run("pyvec ::shallowcopy", [&]() { nanobench::doNotOptimizeAway(pv.copy()); })
-        .run("pyvec ::deepcopy", [&]() { nanobench::doNotOptimizeAway(pv.deepcopy()); })
-        .run("pyvec ::collect", [&]() { nanobench::doNotOptimizeAway(pv.collect()); })
-        .run("pyvec ::from_vec", [&]() { nanobench::doNotOptimizeAway(pyvec<int>{v}); })
-        .run(
-            "vector::sort",
-            [&]() {
-                std::vector v2(v);
-                std::sort(v2.begin(), v2.end(), [](int a, int b) { return a > b; });
-                nanobench::doNotOptimizeAway(v2);
-            }
-        )
-        .run(
-            "pyvec ::sort",
-            [&]() {
-                pyvec<int> v2 = pv.copy();
-                v2.sort(true);
-                nanobench::doNotOptimizeAway(v2);
-            }
-        )
-        .run(
-            "vector::filter",
-            [&]() {
-                std::vector<int> v2;
-                std::copy_if(v.begin(), v.end(), std::back_inserter(v2), [](int i) {
-                    return i % 2 == 0;
+            });
+    }
+
+    template<typename T>
+    void copy(const std::string& type_name, const size_t n) {
+        const auto data = make_data<T>(n, order::random);
+        pyvec<T>   list(data.begin(), data.end());
+        bench("copy<" + type_name + ">", n, n)
+            .run("vector copy", [&] { nanobench::doNotOptimizeAway(std::vector<T>(data)); })
+            .run("pyvec copy", [&] { nanobench::doNotOptimizeAway(list.copy()); })
+            .run("pyvec deepcopy", [&] { nanobench::doNotOptimizeAway(list.deepcopy()); })
+            .run("pyvec collect", [&] { nanobench::doNotOptimizeAway(list.collect()); })
+            .run("pyvec from vector", [&] { nanobench::doNotOptimizeAway(pyvec<T>(data)); });
+    }
+
+    template<typename T>
+    void edits(const std::string& type_name, const size_t n) {
+        const auto     data  = make_data<T>(n, order::random);
+        const T        value = make_value<T>(n);
+        std::vector<T> vector(data);
+        pyvec<T>       list(data.begin(), data.end());
+        const auto     mid = static_cast<std::ptrdiff_t>(n / 2);
+        // popped slots are never reused, compaction keeps the storage bounded
+        list.set_compact_threshold(0.5);
+        // every iteration restores the size, so the lists do not drift
+        bench("insert+pop middle<" + type_name + ">", n, 2 * edit_ops)
+            .run(
+                "vector",
+                [&] {
+                    for (size_t i = 0; i < edit_ops; ++i) {
+                        vector.insert(vector.begin() + mid, value);
+                        vector.erase(vector.begin() + mid);
+                    }
+                }
+            )
+            .run("pyvec", [&] {
+                for (size_t i = 0; i < edit_ops; ++i) {
+                    list.insert(mid, value);
+                    nanobench::doNotOptimizeAway(list.pop(mid));
+                }
+            });
+        bench("pop(0)+append<" + type_name + ">", n, 2 * edit_ops)
+            .run(
+                "vector",
+                [&] {
+                    for (size_t i = 0; i < edit_ops; ++i) {
+                        T front = std::move(vector.front());
+                        vector.erase(vector.begin());
+                        vector.push_back(std::move(front));
+                    }
+                }
+            )
+            .run("pyvec", [&] {
+                for (size_t i = 0; i < edit_ops; ++i) { list.append(*list.pop(0)); }
+            });
+    }
+
+    template<typename T>
+    void slices(const std::string& type_name, const size_t n) {
+        const auto     data = make_data<T>(n, order::random);
+        pyvec<T>       list(data.begin(), data.end());
+        const slice    cut(n / 4, 3 * n / 4, 2);
+        const auto     count = n / 4;
+        std::vector<T> values(data.begin(), data.begin() + count);
+        // every setitem adds a chunk for the new values, compaction keeps the storage bounded
+        list.set_compact_threshold(0.5);
+        bench("slice<" + type_name + ">", n, count)
+            .run("getitem", [&] { nanobench::doNotOptimizeAway(list.getitem(cut)); })
+            .run("setitem", [&] { list.setitem(cut, values.begin(), values.end()); })
+            .run("copy", [&] { nanobench::doNotOptimizeAway(list.copy()); })
+            .run("copy+delitem", [&] {
+                auto copy = list.copy();
+                copy.delitem(cut);
+                nanobench::doNotOptimizeAway(copy);
+            });
+    }
+
+    template<typename T>
+    void sort(const std::string& type_name, const size_t n) {
+        const std::array<std::pair<order, std::string>, 3> orders{
+            {{order::random, "random"}, {order::sorted, "sorted"}, {order::reversed, "reversed"}}
+        };
+        for (const auto& [kind, name] : orders) {
+            const auto data = make_data<T>(n, kind);
+            pyvec<T>   list(data.begin(), data.end());
+            bench("sort " + name + "<" + type_name + ">", n, n)
+                .run(
+                    "vector",
+                    [&] {
+                        std::vector<T> v(data);
+                        std::sort(v.begin(), v.end());
+                        nanobench::doNotOptimizeAway(v);
+                    }
+                )
+                .run("pyvec", [&] {
+                    // a shallow copy only owns its pointer table, the elements stay put
+                    auto copy = list.copy();
+                    copy.sort();
+                    nanobench::doNotOptimizeAway(copy);
                 });
-                nanobench::doNotOptimizeAway(v2);
-            }
-        )
-        .run(
-            "pyvec ::filter",
-            [&]() {
-                auto pv2 = pv.copy();
-                pv2.filter([](int i) { return i % 2 == 0; });
-                nanobench::doNotOptimizeAway(pv2);
-            }
-        )
-        .run(
-            "vector::sum",
-            [&]() {
-                size_t sum = 0;
-                for (const auto& i : v) { sum = (sum + i) % 1000000007; }
-                nanobench::doNotOptimizeAway(sum);
-            }
-        )
-        .run(
-            "pyvec ::sum",
-            [&]() {
-                size_t sum = 0;
-                for (const auto& i : pv) { sum = (sum + i) % 1000000007; }
+        }
+    }
+
+    template<typename T>
+    void scan(const std::string& type_name, const size_t n) {
+        const auto data = make_data<T>(n, order::random);
+        pyvec<T>   list(data.begin(), data.end());
+        bench("filter<" + type_name + ">", n, n)
+            .run(
+                "vector",
+                [&] {
+                    std::vector<T> v;
+                    std::copy_if(data.begin(), data.end(), std::back_inserter(v), [](const T& x) {
+                        return key(x) % 2 == 0;
+                    });
+                    nanobench::doNotOptimizeAway(v);
+                }
+            )
+            .run("pyvec", [&] {
+                auto copy = list.copy();
+                copy.filter([](const T& x) { return key(x) % 2 == 0; });
+                nanobench::doNotOptimizeAway(copy);
+            });
+        bench("sum<" + type_name + ">", n, n)
+            .run(
+                "vector",
+                [&] {
+                    uint64_t sum = 0;
+                    for (const auto& x : data) { sum += key(x); }
+                    nanobench::doNotOptimizeAway(sum);
+                }
+            )
+            .run("pyvec", [&] {
+                uint64_t sum = 0;
+                for (const auto& x : list) { sum += key(x); }
                 nanobench::doNotOptimizeAway(sum);
-            }
-        )
-        // clang-format off
-    ;
-    // clang-format on
-}
\ No newline at end of file
+            });
+    }
+};
+
+}   // namespace
+
+int main(int argc, char** argv) {
+    const size_t      max_size = argc > 1 ? static_cast<size_t>(std::stod(argv[1])) : 1000000;
+    const std::string prefix   = argc > 2 ? argv[2] : "pyvec_bench";
+
+    suite benches(max_size);
+    benches.run<int>("int");
+    benches.run<std::string>("string");
+    benches.run<big>("big");
+    benches.render(prefix);
+    std::cout << "results written to " << prefix << ".json and " << prefix << ".csv" << std::endl;
+}
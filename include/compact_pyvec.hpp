@@ -0,0 +1,509 @@
+#pragma once
+#ifndef COMPACT_PYVEC_HPP
+#define COMPACT_PYVEC_HPP
+
+#include "pyvec.hpp"
+
+namespace pycontainer {
+// pyvec whose table holds 4 byte handles instead of T*, half the table of pyvec on 64-bit
+// targets. A handle numbers the element slots of a storage in the order they are handed out;
+// chunk c holds first_chunk << c of them, so a handle finds its chunk with one bit_width and
+// its element through a table of chunk bases. One storage hands out up to about 2^32 slots,
+// dead elements included, after that adding elements throws std::length_error.
+// Otherwise it behaves like pyvec: elements never move, the table gives the logical order,
+// copy() and slices share the storage and the copy constructor is deep
+template<typename T, typename Alloc = std::allocator<T>>
+class compact_pyvec {
+public:
+    using value_type      = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using pointer         = T*;
+    using const_pointer   = const T*;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using allocator_type  = Alloc;
+    using handle_type     = std::uint32_t;
+
+private:
+    template<typename U>
+    using alloc_of = typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+    template<typename U>
+    using vec = std::vector<U, alloc_of<U>>;
+    template<typename U>
+    using shared = std::shared_ptr<U>;
+
+    // slots of chunk 0, every further chunk doubles
+    static constexpr size_t first_shift = 6;
+    static constexpr size_t first_chunk = size_t{1} << first_shift;
+    // chunks a handle can reach: chunk c ends at first_chunk * (2^(c + 1) - 1)
+    static constexpr size_t max_chunks = 32 - first_shift;
+    // as many bytes inline as the pointer table of pyvec
+    static constexpr size_t small_size = 16;
+    // below this size the comparison sort wins over radix passes
+    static constexpr size_t radix_threshold = 256;
+
+    // chunk c holds the handles [chunk_start(c), chunk_start(c + 1)) and never reallocates
+    struct storage {
+        vec<vec<T>> chunks;
+        // chunks[c].data(), all a handle lookup reads besides the element
+        std::array<pointer, max_chunks> bases{};
+        // slots handed out so far, the handle of the next element
+        size_type used = 0;
+
+        explicit storage(const Alloc& alloc) : chunks(alloc) {}
+    };
+
+    using table = detail::ptr_table<handle_type, alloc_of<handle_type>, small_size>;
+
+    // created on the first insertion, empty instances own no chunks
+    shared<storage> _storage;
+    table           _handles;
+
+public:
+    template<typename V>
+    class iterator_of;
+    using iterator       = iterator_of<T>;
+    using const_iterator = iterator_of<const T>;
+
+    compact_pyvec() = default;
+
+    explicit compact_pyvec(const Alloc& alloc) : _handles(alloc_of<handle_type>(alloc)) {}
+
+    template<typename InputIt>
+    compact_pyvec(is_input_iterator_t<InputIt> first, InputIt last, const Alloc& alloc = Alloc()) :
+        compact_pyvec(alloc) {
+        extend<InputIt>(first, last);
+    }
+
+    compact_pyvec(std::initializer_list<T> il, const Alloc& alloc = Alloc()) : compact_pyvec(alloc) {
+        extend<const T*>(il.begin(), il.end());
+    }
+
+    // deep copy like pyvec's, the elements land in consecutive slots of a storage of its own
+    compact_pyvec(const compact_pyvec& other) :
+        compact_pyvec(std::allocator_traits<Alloc>::select_on_container_copy_construction(
+            other.get_allocator()
+        )) {
+        extend(other);
+    }
+
+    compact_pyvec(compact_pyvec&&) noexcept = default;
+
+    compact_pyvec& operator=(const compact_pyvec& other) {
+        if (this != &other) {
+            clear();
+            extend(other);
+        }
+        return *this;
+    }
+
+    compact_pyvec& operator=(compact_pyvec&&) noexcept = default;
+    ~compact_pyvec()                                   = default;
+
+    [[nodiscard]] allocator_type get_allocator() const { return Alloc(_handles.get_allocator()); }
+
+    /*
+     *  Pyhton-List-Like Interface
+     */
+    void append(const T& value) { emplace_back(value); }
+    void append(T&& value) { emplace_back(std::move(value)); }
+
+    template<typename InputIt>
+    void extend(is_input_iterator_t<InputIt> first, InputIt last) {
+        if constexpr (detail::is_forward_iterator_v<InputIt>) {
+            reserve(size() + static_cast<size_type>(std::distance(first, last)));
+        }
+        for (; first != last; ++first) { emplace_back(*first); }
+    }
+
+    void extend(const compact_pyvec& other) {
+        if (&other == this) { return extend(compact_pyvec(other)); }
+        extend<const_iterator>(other.begin(), other.end());
+    }
+
+    // moves the elements unless copies sharing other's storage still see them
+    void extend(compact_pyvec&& other) {
+        if (&other == this || (other._storage && other._storage.use_count() > 1)) {
+            return extend(static_cast<const compact_pyvec&>(other));
+        }
+        reserve(size() + other.size());
+        for (auto& x : other) { emplace_back(std::move(x)); }
+        other.clear();
+    }
+
+    void extend(std::initializer_list<T> il) { extend<const T*>(il.begin(), il.end()); }
+
+    void insert(const difference_type index, const T& value) {
+        const auto pos = index >= static_cast<difference_type>(size()) ? size() : pypos(index);
+        const auto h   = emplace_slot(value);
+        *_handles.insert_gap(pos, 1) = h;
+    }
+
+    shared<T> pop(const difference_type index = -1) {
+        const auto pos = pypos(index);
+        auto       ans = share(pos);
+        _handles.erase(_handles.begin() + pos);
+        return ans;
+    }
+
+    void remove(const T& value) {
+        const auto pos = find_value(value, 0, size());
+        if (pos == size()) { throw std::invalid_argument("compact_pyvec::remove: value not found"); }
+        _handles.erase(_handles.begin() + pos);
+    }
+
+    void reverse() { std::reverse(_handles.begin(), _handles.end()); }
+
+    void clear() {
+        _handles.clear();
+        _storage = nullptr;
+    }
+
+    // shallow copy sharing the elements
+    compact_pyvec copy() const {
+        compact_pyvec ans(get_allocator());
+        ans._storage = _storage;
+        ans._handles.assign(_handles.begin(), _handles.end());
+        return ans;
+    }
+
+    compact_pyvec deepcopy() const { return compact_pyvec(*this); }
+
+    void sort(const bool reverse = false) {
+        sort([](const T& x) -> const T& { return x; }, reverse);
+    }
+
+    // stable; radix sortable keys are decorated once per element, others compared in place
+    template<typename Key>
+    void sort(Key key, const bool reverse) {
+        using key_type = std::decay_t<std::invoke_result_t<Key&, T&>>;
+        if constexpr (detail::radix_sortable_v<key_type>) {
+            if (size() >= radix_threshold) {
+                using radix_type = decltype(detail::radix_key(std::declval<key_type>()));
+                std::vector<std::pair<radix_type, handle_type>> decorated;
+                decorated.reserve(size());
+                for (const auto h : _handles) {
+                    const auto k = detail::radix_key(static_cast<key_type>(key(element(h))));
+                    // inverting the key sorts descending while equal keys keep their order
+                    decorated.emplace_back(reverse ? static_cast<radix_type>(~k) : k, h);
+                }
+                detail::radix_sort(decorated.data(), decorated.size());
+                auto target = _handles.data();
+                for (const auto& [_, h] : decorated) { *target++ = h; }
+                return;
+            }
+        }
+        auto cmp = [&](const handle_type a, const handle_type b) {
+            return key(element(a)) < key(element(b));
+        };
+        if (reverse) {
+            gfx::timsort(_handles.rbegin(), _handles.rend(), cmp);
+        } else {
+            gfx::timsort(_handles.begin(), _handles.end(), cmp);
+        }
+    }
+
+    template<typename Func>
+    void filter(Func func) {
+        auto it = std::remove_if(_handles.begin(), _handles.end(), [&](const handle_type h) {
+            return !func(element(h));
+        });
+        _handles.erase(it, _handles.end());
+    }
+
+    size_t index(
+        const T&                             value,
+        const std::optional<difference_type> start = std::nullopt,
+        const std::optional<difference_type> stop  = std::nullopt
+    ) const {
+        const auto      left  = pypos(start.value_or(0));
+        difference_type right = stop.value_or(static_cast<difference_type>(size()));
+        right = right >= static_cast<difference_type>(size()) ? size() : pypos(right);
+        if (const auto ans = find_value(value, left, right); ans != static_cast<size_type>(right)) {
+            return ans;
+        }
+        throw std::invalid_argument("compact_pyvec::index: value not found");
+    }
+
+    [[nodiscard]] size_type count(const T& value) const {
+        return static_cast<size_type>(std::count_if(begin(), end(), [&](const T& x) {
+            return x == value;
+        }));
+    }
+
+    /*
+     *  Python Magic Method
+     *  __getitem__, __setitem__, __delitem__, __contains__
+     */
+    shared<T> getitem(const difference_type index) { return share(pypos(index)); }
+
+    // shallow copy when slicing
+    compact_pyvec getitem(const slice& t_slice) const {
+        const auto    s = detail::build_slice(t_slice, size());
+        compact_pyvec ans(get_allocator());
+        if (s.num_steps == 0) { return ans; }
+        ans._storage = _storage;
+        ans._handles.reserve(s.num_steps);
+        auto pos = static_cast<difference_type>(s.start);
+        for (size_type i = 0; i < s.num_steps; ++i, pos += s.step) {
+            ans._handles.push_back(_handles[pos]);
+        }
+        return ans;
+    }
+
+    // the element gets a new slot, copies sharing the storage keep the old value
+    void setitem(const difference_type index, const T& value) {
+        const auto pos = pypos(index);
+        _handles[pos]  = emplace_slot(value);
+    }
+
+    void delitem(const difference_type index) {
+        const auto pos = pypos(index);
+        _handles.erase(_handles.begin() + pos);
+    }
+
+    void delitem(const slice& t_slice) {
+        const auto s = detail::build_slice(t_slice, size());
+        if (s.num_steps == 0) { return; }
+        // walk the deleted positions upwards, whatever the direction of the slice
+        const auto step   = static_cast<size_type>(s.step > 0 ? s.step : -s.step);
+        const auto first  = s.step > 0 ? s.start : s.start - (s.num_steps - 1) * step;
+        const auto last   = first + (s.num_steps - 1) * step;
+        const auto data   = _handles.data();
+        auto       target = data + first;
+        for (auto gap = first; gap < last; gap += step) {
+            target = std::copy(data + gap + 1, data + gap + step, target);
+        }
+        std::copy(data + last + 1, data + _handles.size(), target);
+        _handles.resize(_handles.size() - s.num_steps);
+    }
+
+    [[nodiscard]] bool contains(const T& value) const {
+        return find_value(value, 0, size()) != size();
+    }
+
+    /*
+     *  C++-Vector-Like Interface
+     */
+    reference       operator[](const size_type pos) { return element(_handles[pos]); }
+    const_reference operator[](const size_type pos) const { return element(_handles[pos]); }
+
+    reference at(const size_type pos) {
+        if (pos >= size()) { throw std::out_of_range("compact_pyvec::at"); }
+        return element(_handles[pos]);
+    }
+
+    const_reference at(const size_type pos) const {
+        if (pos >= size()) { throw std::out_of_range("compact_pyvec::at"); }
+        return element(_handles[pos]);
+    }
+
+    reference       front() { return element(_handles.front()); }
+    const_reference front() const { return element(_handles.front()); }
+    reference       back() { return element(_handles.back()); }
+    const_reference back() const { return element(_handles.back()); }
+
+    iterator       begin() { return iterator(_handles.begin(), _storage.get()); }
+    const_iterator begin() const { return const_iterator(_handles.begin(), _storage.get()); }
+    const_iterator cbegin() const { return begin(); }
+    iterator       end() { return iterator(_handles.end(), _storage.get()); }
+    const_iterator end() const { return const_iterator(_handles.end(), _storage.get()); }
+    const_iterator cend() const { return end(); }
+
+    [[nodiscard]] bool      empty() const { return _handles.empty(); }
+    [[nodiscard]] size_type size() const { return _handles.size(); }
+
+    // room for new_cap elements: the table, and chunks for the slots the appends take
+    void reserve(const size_type new_cap) {
+        _handles.reserve(new_cap);
+        if (new_cap <= size()) { return; }
+        try_init();
+        const auto needed = _storage->used + (new_cap - size());
+        while (capacity() < needed && _storage->chunks.size() < max_chunks) { add_chunk(); }
+    }
+
+    // element slots of all chunks, shared with shallow copies
+    [[nodiscard]] size_type capacity() const {
+        return _storage ? chunk_start(_storage->chunks.size()) : 0;
+    }
+
+    // heap bytes held by the handle table and the (possibly shared) chunks
+    [[nodiscard]] size_type memory_usage() const {
+        size_type bytes = _handles.allocated() * sizeof(handle_type);
+        if (!_storage) { return bytes; }
+        bytes += sizeof(storage) + _storage->chunks.capacity() * sizeof(vec<T>);
+        return bytes + capacity() * sizeof(T);
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    template<typename... Args>
+    reference emplace_back(Args&&... args) {
+        const auto h = emplace_slot(std::forward<Args>(args)...);
+        _handles.push_back(h);
+        return element(h);
+    }
+
+    void pop_back() { _handles.pop_back(); }
+
+    void swap(compact_pyvec& other) noexcept {
+        std::swap(_storage, other._storage);
+        std::swap(_handles, other._handles);
+    }
+
+    bool operator==(const compact_pyvec& other) const {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+    bool operator!=(const compact_pyvec& other) const { return !(*this == other); }
+
+    vec<T> collect() const { return vec<T>(begin(), end(), get_allocator()); }
+
+private:
+    static constexpr size_type chunk_start(const size_type c) {
+        return first_chunk * ((size_type{1} << c) - 1);
+    }
+
+    static constexpr size_type chunk_of(const size_type h) {
+        return static_cast<size_type>(std::bit_width((h >> first_shift) + 1)) - 1;
+    }
+
+    static pointer decode(const storage& block, const handle_type h) {
+        const auto c = chunk_of(h);
+        return block.bases[c] + (h - chunk_start(c));
+    }
+
+    reference       element(const handle_type h) { return *decode(*_storage, h); }
+    const_reference element(const handle_type h) const { return *decode(*_storage, h); }
+
+    void try_init() {
+        if (!_storage) { _storage = std::allocate_shared<storage>(get_allocator(), get_allocator()); }
+    }
+
+    void add_chunk() {
+        auto&      block = *_storage;
+        const auto c     = block.chunks.size();
+        vec<T>     chunk(get_allocator());
+        chunk.reserve(first_chunk << c);
+        block.chunks.push_back(std::move(chunk));
+        block.bases[c] = block.chunks.back().data();
+    }
+
+    // construct an element in the next slot, the chunk it lands in never grows past its size
+    template<typename... Args>
+    handle_type emplace_slot(Args&&... args) {
+        try_init();
+        auto&      block = *_storage;
+        const auto c     = chunk_of(block.used);
+        if (c == block.chunks.size()) {
+            if (c == max_chunks) {
+                throw std::length_error("compact_pyvec: storage ran out of 32-bit handles");
+            }
+            add_chunk();
+        }
+        block.chunks[c].emplace_back(std::forward<Args>(args)...);
+        return static_cast<handle_type>(block.used++);
+    }
+
+    shared<T> share(const size_type pos) {
+        return shared<T>(_storage, &element(_handles[pos]));
+    }
+
+    [[nodiscard]] size_type find_value(const T& value, const size_type first, const size_type last) const {
+        for (size_type i = first; i < last; ++i) {
+            if (element(_handles[i]) == value) { return i; }
+        }
+        return last;
+    }
+
+    [[nodiscard]] size_type pypos(const difference_type index) const {
+        difference_type ans = index;
+        if (ans < 0) { ans += static_cast<difference_type>(size()); }
+        if (ans < 0 || ans >= static_cast<difference_type>(size())) {
+            throw std::out_of_range("compact_pyvec::index out of range: " + std::to_string(index));
+        }
+        return static_cast<size_type>(ans);
+    }
+};
+
+// random access over the handle table, every dereference decodes one handle
+template<typename T, typename Alloc>
+template<typename V>
+class compact_pyvec<T, Alloc>::iterator_of {
+    friend class compact_pyvec;
+    template<typename>
+    friend class iterator_of;
+    using handle_pointer = std::conditional_t<std::is_const_v<V>, const handle_type*, handle_type*>;
+
+    handle_pointer _handle  = nullptr;
+    const storage* _storage = nullptr;
+
+    iterator_of(handle_pointer handle, const storage* block) : _handle(handle), _storage(block) {}
+
+public:
+    using value_type        = T;
+    using reference         = V&;
+    using pointer           = V*;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::random_access_iterator_tag;
+
+    iterator_of() = default;
+
+    // allow implicit conversion from iterator to const_iterator
+    template<typename W, typename = std::enable_if_t<std::is_const_v<V> && !std::is_const_v<W>>>
+    iterator_of(const iterator_of<W>& other) : _handle(other._handle), _storage(other._storage) {}
+
+    reference operator*() const { return *decode(*_storage, *_handle); }
+    pointer   operator->() const { return decode(*_storage, *_handle); }
+    reference operator[](const difference_type i) const { return *decode(*_storage, _handle[i]); }
+
+    iterator_of& operator+=(const difference_type i) {
+        _handle += i;
+        return *this;
+    }
+
+    iterator_of& operator-=(const difference_type i) {
+        _handle -= i;
+        return *this;
+    }
+
+    iterator_of& operator++() {
+        ++_handle;
+        return *this;
+    }
+
+    iterator_of& operator--() {
+        --_handle;
+        return *this;
+    }
+
+    iterator_of operator++(int) {
+        iterator_of tmp = *this;
+        ++_handle;
+        return tmp;
+    }
+
+    iterator_of operator--(int) {
+        iterator_of tmp = *this;
+        --_handle;
+        return tmp;
+    }
+
+    iterator_of operator+(const difference_type i) const { return iterator_of(_handle + i, _storage); }
+    iterator_of operator-(const difference_type i) const { return iterator_of(_handle - i, _storage); }
+    friend iterator_of operator+(const difference_type i, const iterator_of& it) { return it + i; }
+
+    difference_type operator-(const iterator_of& other) const { return _handle - other._handle; }
+
+    // operator <=>
+    bool operator==(const iterator_of& other) const { return _handle == other._handle; }
+    bool operator!=(const iterator_of& other) const { return _handle != other._handle; }
+    bool operator<(const iterator_of& other) const { return _handle < other._handle; }
+    bool operator>(const iterator_of& other) const { return _handle > other._handle; }
+    bool operator<=(const iterator_of& other) const { return _handle <= other._handle; }
+    bool operator>=(const iterator_of& other) const { return _handle >= other._handle; }
+};
+}   // namespace pycontainer
+
+#endif   // COMPACT_PYVEC_HPP
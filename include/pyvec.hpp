@@ -7,8 +7,44 @@
 #include <stdexcept>
 #include <optional>
 #include <string>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <span>
+#include <thread>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <compare>
+#include <ranges>
+#include <fstream>
+#include <unordered_map>
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
 #include "timsort.hpp"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PYVEC_HAS_MMAP 1
+#endif
+
+// define PYVEC_COUNTERS to have pyvec_stats report chunk allocations and free index scans
+#if defined(PYVEC_COUNTERS)
+#define PYVEC_COUNT(counter) (++(counter))
+#else
+#define PYVEC_COUNT(counter) ((void) 0)
+#endif
+
 namespace pycontainer {
 struct slice {
     std::optional<ptrdiff_t> start, stop, step;
@@ -20,6 +56,38 @@ struct slice {
     ) : start(start), stop(stop), step(step) {}
 };
 
+// how a pyvec sizes the chunks it allocates
+struct growth_policy {
+    // each new chunk grows the total capacity by this factor, must be greater than 1
+    double factor = 2;
+    // upper bound of a single chunk in bytes, 0 for none; a larger insertion still gets one chunk
+    size_t max_chunk_bytes = 0;
+    // round chunk sizes up to whole pages, max_chunk_bytes takes precedence
+    bool page_align = false;
+};
+
+// snapshot of how a pyvec uses its storage, see pyvec::stats()
+struct pyvec_stats {
+    size_t chunks   = 0;
+    // element slots of all chunks and the slots holding a constructed element
+    size_t capacity = 0;
+    size_t used     = 0;
+    // elements this instance refers to
+    size_t live = 0;
+    // share of constructed elements this instance no longer refers to
+    double fragmentation = 0;
+    // heap bytes of the pointer table, 0 while it fits inside the object
+    size_t table_bytes = 0;
+    // instances and handles sharing the storage
+    long storage_use_count = 0;
+    // share of neighbouring entries whose elements are adjacent in memory
+    double locality = 1;
+    // only counted with PYVEC_COUNTERS and shared by everything using the storage:
+    // chunks created or adopted, and free index entries looked at for an insertion
+    size_t chunk_allocations = 0;
+    size_t chunk_scans       = 0;
+};
+
 template<class InputIt>
 using is_input_iterator_t = std::enable_if_t<
     std::is_base_of_v<
@@ -34,7 +102,588 @@ using is_random_access_iterator_t = std::enable_if_t<
         typename std::iterator_traits<InputIt>::iterator_category>,
     InputIt>;
 
+namespace detail {
+// multi-pass ranges can be measured before they are copied
+template<class It>
+constexpr bool is_forward_iterator_v = std::is_base_of_v<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<It>::iterator_category>;
+
+// a bool that const queries may cache a finding in while other threads read the same
+// instance: relaxed atomic loads and stores, copied by value
+class cached_flag {
+    std::atomic<bool> _value;
+
+public:
+    cached_flag(const bool value) noexcept : _value(value) {}
+    cached_flag(const cached_flag& other) noexcept : _value(static_cast<bool>(other)) {}
+
+    cached_flag& operator=(const cached_flag& other) noexcept {
+        return *this = static_cast<bool>(other);
+    }
+    cached_flag& operator=(const bool value) noexcept {
+        _value.store(value, std::memory_order_relaxed);
+        return *this;
+    }
+
+    operator bool() const noexcept { return _value.load(std::memory_order_relaxed); }
+};
+
+// keys that can be mapped onto an unsigned integer preserving operator< order
+template<typename K>
+inline constexpr bool radix_sortable_v =
+    std::is_integral_v<K> || (std::is_floating_point_v<K> && (sizeof(K) == 4 || sizeof(K) == 8));
+
+// element types sortedness can be tracked for
+template<typename T>
+inline constexpr bool less_comparable_v = requires(const T& a) { static_cast<bool>(a < a); };
+
+// b may follow a in ascending order; pairs neither ordered nor equal, like NaN, break it
+template<typename T>
+bool in_order(const T& a, const T& b) {
+    if constexpr (requires { static_cast<bool>(a == b); }) {
+        return !(b < a) && (a < b || a == b);
+    } else {
+        return !(b < a);
+    }
+}
+
+// element types a hash index can be kept for
+template<typename T>
+inline constexpr bool hashable_v = requires(const T& a) {
+    { std::hash<T>{}(a) } -> std::convertible_to<size_t>;
+};
+
+struct hash_entry {
+    size_t count = 0;
+    size_t first = 0;
+};
+
+// occurrences and first position of every value of a pyvec, see pyvec::set_hash_index()
+template<typename T, typename Alloc, bool = hashable_v<T>>
+struct hash_index {
+    explicit hash_index(const Alloc&) {}
+};
+
+template<typename T, typename Alloc>
+struct hash_index<T, Alloc, true> {
+    using value_type = std::pair<const T, hash_entry>;
+    using map_alloc  = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+
+    std::unordered_map<T, hash_entry, std::hash<T>, std::equal_to<T>, map_alloc> entries;
+    // the counts match the pointer table, and so do the first positions
+    bool counted    = false;
+    bool positioned = false;
+    // const lookups may run on several threads, the lazy rebuild and the lookup hold it
+    std::mutex lock;
+
+    explicit hash_index(const Alloc& alloc) : entries(map_alloc(alloc)) {}
+};
+
+template<typename K>
+auto radix_key(K key) {
+    if constexpr (std::is_same_v<K, bool>) {
+        return static_cast<std::uint8_t>(key);
+    } else if constexpr (std::is_integral_v<K>) {
+        using U = std::make_unsigned_t<K>;
+        auto u  = static_cast<U>(key);
+        if constexpr (std::is_signed_v<K>) { u ^= U{1} << (sizeof(K) * 8 - 1); }
+        return u;
+    } else {
+        using U             = std::conditional_t<sizeof(K) == 4, std::uint32_t, std::uint64_t>;
+        constexpr auto sign = U{1} << (sizeof(K) * 8 - 1);
+        if (key == K{0}) { key = K{0}; }   // -0.0 and 0.0 compare equal
+        const auto u = std::bit_cast<U>(key);
+        return (u & sign) ? static_cast<U>(~u) : static_cast<U>(u | sign);
+    }
+}
+
+// stable LSD radix sort of (key, value) pairs by key, one byte per pass
+template<typename U, typename V>
+void radix_sort(std::pair<U, V>* const first, const size_t n) {
+    if (n < 2) { return; }
+    constexpr size_t passes = sizeof(U);
+    std::array<std::array<size_t, 256>, passes> counts{};
+    for (auto item = first; item != first + n; ++item) {
+        for (size_t p = 0; p < passes; ++p) { ++counts[p][(item->first >> (p * 8)) & 0xFF]; }
+    }
+
+    std::vector<std::pair<U, V>> buffer(n);
+    auto                         src = first;
+    auto                         dst = buffer.data();
+    for (size_t p = 0; p < passes; ++p) {
+        auto& count = counts[p];
+        // all keys share this byte, the pass would not move anything
+        if (count[(first->first >> (p * 8)) & 0xFF] == n) { continue; }
+        size_t offset = 0;
+        for (auto& c : count) { offset += std::exchange(c, offset); }
+        for (auto item = src; item != src + n; ++item) {
+            dst[count[(item->first >> (p * 8)) & 0xFF]++] = *item;
+        }
+        std::swap(src, dst);
+    }
+    if (src != first) { std::copy(src, src + n, first); }
+}
+
+inline size_t resolve_threads(const size_t n_threads) {
+    if (n_threads != 0) { return n_threads; }
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+// [n * i / blocks, n * (i + 1) / blocks) is the i-th block
+inline std::vector<size_t> block_bounds(const size_t n, const size_t blocks) {
+    std::vector<size_t> bounds(blocks + 1);
+    for (size_t i = 0; i <= blocks; ++i) { bounds[i] = n * i / blocks; }
+    return bounds;
+}
+
+// run func(0) ... func(n_tasks - 1) on their own threads and rethrow the first failure
+template<typename Func>
+void parallel_for(const size_t n_tasks, Func func) {
+    std::vector<std::exception_ptr> errors(n_tasks);
+    std::vector<std::thread>        threads;
+    auto                            task = [&](const size_t i) {
+        try {
+            func(i);
+        } catch (...) { errors[i] = std::current_exception(); }
+    };
+    threads.reserve(n_tasks);
+    for (size_t i = 1; i < n_tasks; ++i) { threads.emplace_back(task, i); }
+    if (n_tasks > 0) { task(0); }
+    for (auto& thread : threads) { thread.join(); }
+    for (auto& error : errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+}
+
+// sort every block concurrently, then stably merge neighbouring runs pass by pass
+template<typename RandomIt, typename SortRun, typename Compare>
+void parallel_merge_sort(
+    RandomIt first, const std::vector<size_t>& bounds, SortRun sort_run, Compare cmp
+) {
+    const size_t blocks = bounds.size() - 1;
+    parallel_for(blocks, [&](const size_t i) {
+        sort_run(first + bounds[i], first + bounds[i + 1]);
+    });
+    for (size_t width = 1; width < blocks; width *= 2) {
+        parallel_for((blocks + 2 * width - 1) / (2 * width), [&](const size_t m) {
+            const size_t lo  = 2 * m * width;
+            const size_t mid = lo + width;
+            const size_t hi  = std::min(lo + 2 * width, blocks);
+            if (mid < hi) {
+                gfx::timmerge(first + bounds[lo], first + bounds[mid], first + bounds[hi], cmp);
+            }
+        });
+    }
+}
+
+/*
+ *  Search kernels for arithmetic element types
+ *  The portable loops are branch-free over fixed-size blocks so that compilers vectorize them
+ *  (SSE2 / NEON), 4 and 8 byte elements get explicit AVX2 kernels when it is enabled.
+ */
+
+inline constexpr size_t search_block = 16;
+
+#if defined(__AVX2__)
+template<typename T>
+inline constexpr bool avx2_searchable_v = std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+                                          (sizeof(T) == 4 || sizeof(T) == 8);
+
+// bit i of the result is set when data[i] == value, for the next 32 / sizeof(T) elements
+template<typename T>
+unsigned avx2_equal_mask(const T* data, const T value) {
+    const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    if constexpr (std::is_same_v<T, float>) {
+        const auto eq = _mm256_cmp_ps(_mm256_castsi256_ps(x), _mm256_set1_ps(value), _CMP_EQ_OQ);
+        return static_cast<unsigned>(_mm256_movemask_ps(eq));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        const auto eq = _mm256_cmp_pd(_mm256_castsi256_pd(x), _mm256_set1_pd(value), _CMP_EQ_OQ);
+        return static_cast<unsigned>(_mm256_movemask_pd(eq));
+    } else if constexpr (sizeof(T) == 4) {
+        const auto eq = _mm256_cmpeq_epi32(x, _mm256_set1_epi32(static_cast<int>(value)));
+        return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+    } else {
+        const auto eq = _mm256_cmpeq_epi64(x, _mm256_set1_epi64x(static_cast<long long>(value)));
+        return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(eq)));
+    }
+}
+#endif
+
+template<typename T>
+size_t count_equal(const T* data, const size_t n, const T value) {
+    size_t cnt = 0;
+    size_t i   = 0;
+#if defined(__AVX2__)
+    if constexpr (avx2_searchable_v<T>) {
+        constexpr size_t lanes = 32 / sizeof(T);
+        for (; i + lanes <= n; i += lanes) { cnt += std::popcount(avx2_equal_mask(data + i, value)); }
+    }
+#endif
+    for (; i + search_block <= n; i += search_block) {
+        unsigned block = 0;
+        for (size_t j = 0; j < search_block; ++j) { block += data[i + j] == value; }
+        cnt += block;
+    }
+    for (; i < n; ++i) { cnt += data[i] == value; }
+    return cnt;
+}
+
+// position of the first data[i] == value, n if there is none
+template<typename T>
+size_t find_equal(const T* data, const size_t n, const T value) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    if constexpr (avx2_searchable_v<T>) {
+        constexpr size_t lanes = 32 / sizeof(T);
+        for (; i + lanes <= n; i += lanes) {
+            if (const auto mask = avx2_equal_mask(data + i, value)) {
+                return i + std::countr_zero(mask);
+            }
+        }
+    }
+#endif
+    for (; i + search_block <= n; i += search_block) {
+        bool hit = false;
+        for (size_t j = 0; j < search_block; ++j) { hit |= data[i + j] == value; }
+        if (hit) { break; }
+    }
+    for (; i < n; ++i) {
+        if (data[i] == value) { return i; }
+    }
+    return n;
+}
+
+// same as count_equal, loading every element through its pointer
+template<typename T>
+size_t count_equal_gather(T* const* ptrs, const size_t n, const T value) {
+    size_t cnt = 0;
+    size_t i   = 0;
+    for (; i + search_block <= n; i += search_block) {
+        std::array<T, search_block> block;
+        for (size_t j = 0; j < search_block; ++j) { block[j] = *ptrs[i + j]; }
+        cnt += count_equal(block.data(), search_block, value);
+    }
+    for (; i < n; ++i) { cnt += *ptrs[i] == value; }
+    return cnt;
+}
+
 template<typename T>
+size_t find_equal_gather(T* const* ptrs, const size_t n, const T value) {
+    size_t i = 0;
+    for (; i + search_block <= n; i += search_block) {
+        std::array<T, search_block> block;
+        for (size_t j = 0; j < search_block; ++j) { block[j] = *ptrs[i + j]; }
+        if (const auto pos = find_equal(block.data(), search_block, value); pos != search_block) {
+            return i + pos;
+        }
+    }
+    for (; i < n; ++i) {
+        if (*ptrs[i] == value) { return i; }
+    }
+    return n;
+}
+
+// layout written by pyvec::save: native endianness and element layout, the payload
+// starts right after the header, 64 bytes in, so a mapped file can be used in place
+struct file_header {
+    static constexpr std::array<char, 8> expected_magic{'P', 'Y', 'V', 'E', 'C', '\0', '0', '1'};
+
+    std::array<char, 8> magic        = expected_magic;
+    uint64_t            element_size = 0;
+    uint64_t            count        = 0;
+    uint64_t            reserved[5]  = {};
+};
+static_assert(sizeof(file_header) == 64);
+
+// a slice resolved against a length: num_steps positions from start, step apart
+struct slice_native {
+    size_t    start, num_steps;
+    ptrdiff_t step;
+
+    slice_native(size_t start, size_t num_steps, ptrdiff_t step) :
+        start(start), num_steps(num_steps), step(step) {}
+};
+
+inline slice_native build_slice(const slice& t_slice, const size_t size) {
+    ptrdiff_t      start, stop, num_steps;
+    ptrdiff_t      step   = t_slice.step.value_or(1);
+    auto           v_size = static_cast<ptrdiff_t>(size);
+    constexpr auto zero   = static_cast<ptrdiff_t>(0);
+    if (step == 0) { throw std::invalid_argument("slice::step == 0"); }
+    if (step > 0) {
+        start = t_slice.start.value_or(0);
+        if (start < 0) {
+            start = std::max(zero, start + v_size);
+        } else {
+            start = std::min(start, v_size);
+        }
+
+        stop = t_slice.stop.value_or(v_size);
+        if (stop < 0) {
+            stop = std::max(zero, stop + v_size);
+        } else {
+            stop = std::min(stop, v_size);
+        }
+
+        // integer division truncates towards zero, empty ranges need their own case
+        num_steps = stop > start ? (stop - start - 1) / step + 1 : zero;
+    } else {
+        start = t_slice.start.value_or(v_size - 1);
+        if (start < 0) {
+            start = std::max(static_cast<ptrdiff_t>(-1), start + v_size);
+        } else {
+            start = std::min(start, v_size - 1);
+        }
+
+        if (t_slice.stop.has_value()) {
+            stop = t_slice.stop.value();
+            if (stop < 0) {
+                stop = std::max(static_cast<ptrdiff_t>(-1), stop + v_size);
+            } else {
+                stop = std::min(stop, v_size);
+            }
+        } else {
+            stop = -1;
+        }
+
+        num_steps = start > stop ? (start - stop - 1) / -step + 1 : zero;
+    }
+    return {static_cast<size_t>(start), static_cast<size_t>(num_steps), step};
+}
+
+// pointer table of a pyvec, the first N entries live inside the object so tiny lists
+// never touch the heap for it; entries are raw pointers and copied bitwise.
+// The live entries sit somewhere inside the buffer with headroom on both sides, so
+// inserting or erasing shifts whichever side of the position is shorter
+template<typename P, typename Alloc, size_t N>
+class ptr_table {
+    using traits = std::allocator_traits<Alloc>;
+
+    [[no_unique_address]] Alloc _alloc;
+    P*                          _buf  = _inline;
+    P*                          _data = _inline;
+    size_t                      _size = 0;
+    size_t                      _cap  = N;
+    P                           _inline[N];
+
+public:
+    using value_type             = P;
+    using size_type              = size_t;
+    using iterator               = P*;
+    using const_iterator         = const P*;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    ptr_table() : ptr_table(Alloc()) {}
+
+    explicit ptr_table(const Alloc& alloc) noexcept : _alloc(alloc) {}
+
+    ptr_table(const ptr_table& other) :
+        _alloc(traits::select_on_container_copy_construction(other._alloc)) {
+        assign(other.begin(), other.end());
+    }
+
+    ptr_table(ptr_table&& other) noexcept : _alloc(std::move(other._alloc)) { steal(other); }
+
+    ~ptr_table() { release(); }
+
+    ptr_table& operator=(const ptr_table& other) {
+        if (this != &other) { assign(other.begin(), other.end()); }
+        return *this;
+    }
+
+    ptr_table& operator=(ptr_table&& other) noexcept(
+        traits::propagate_on_container_move_assignment::value || traits::is_always_equal::value
+    ) {
+        if (this == &other) { return *this; }
+        if constexpr (traits::propagate_on_container_move_assignment::value) {
+            release();
+            _alloc = std::move(other._alloc);
+            steal(other);
+        } else {
+            if (_alloc == other._alloc) {
+                release();
+                steal(other);
+            } else {
+                assign(other.begin(), other.end());
+                other.clear();
+            }
+        }
+        return *this;
+    }
+
+    [[nodiscard]] Alloc get_allocator() const { return _alloc; }
+
+    [[nodiscard]] P*       data() { return _data; }
+    [[nodiscard]] const P* data() const { return _data; }
+    [[nodiscard]] size_t   size() const { return _size; }
+    // entries that fit before push_back has to move anything
+    [[nodiscard]] size_t   capacity() const { return _cap - front_room(); }
+    [[nodiscard]] size_t   front_room() const { return static_cast<size_t>(_data - _buf); }
+    [[nodiscard]] size_t   back_room() const { return _cap - front_room() - _size; }
+    // entries held on the heap, 0 while the inline buffer is in use
+    [[nodiscard]] size_t   allocated() const { return _buf == _inline ? 0 : _cap; }
+    [[nodiscard]] bool     empty() const { return _size == 0; }
+
+    P&       operator[](size_t i) { return _data[i]; }
+    const P& operator[](size_t i) const { return _data[i]; }
+    P&       front() { return _data[0]; }
+    const P& front() const { return _data[0]; }
+    P&       back() { return _data[_size - 1]; }
+    const P& back() const { return _data[_size - 1]; }
+
+    iterator               begin() { return _data; }
+    const_iterator         begin() const { return _data; }
+    iterator               end() { return _data + _size; }
+    const_iterator         end() const { return _data + _size; }
+    reverse_iterator       rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator       rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    void reserve(size_t n) {
+        if (n <= capacity()) { return; }
+        if (n <= _cap) {
+            relocate(0);
+        } else {
+            reallocate(n, 0);
+        }
+    }
+
+    void resize(size_t n) {
+        if (n > _size) {
+            if (back_room() < n - _size) { make_room(false, n - _size); }
+            std::fill(_data + _size, _data + n, P{});
+        }
+        _size = n;
+    }
+
+    void push_back(const P value) {
+        if (back_room() == 0) { make_room(false, 1); }
+        _data[_size++] = value;
+    }
+
+    void pop_back() { --_size; }
+
+    void clear() {
+        _size = 0;
+        _data = _buf;
+    }
+
+    // open count unset entries before pos, returns the first of them
+    iterator insert_gap(const size_t pos, const size_t count) {
+        if (pos < _size - pos) {
+            if (front_room() < count) { make_room(true, count); }
+            std::copy(_data, _data + pos, _data - count);
+            _data -= count;
+        } else {
+            if (back_room() < count) { make_room(false, count); }
+            std::copy_backward(_data + pos, _data + _size, _data + _size + count);
+        }
+        _size += count;
+        return _data + pos;
+    }
+
+    iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        const auto head  = static_cast<size_t>(first - _data);
+        const auto count = static_cast<size_t>(last - first);
+        if (head < _size - head - count) {
+            std::copy_backward(_data, _data + head, _data + head + count);
+            _data += count;
+        } else {
+            std::copy(last, static_cast<const_iterator>(end()), _data + head);
+        }
+        _size -= count;
+        return _data + head;
+    }
+
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last) {
+        const auto n = static_cast<size_t>(std::distance(first, last));
+        clear();
+        reserve(n);
+        std::copy(first, last, _data);
+        _size = n;
+    }
+
+    void shrink_to_fit() {
+        if (_buf == _inline || _size == _cap) { return; }
+        if (_size <= N) {
+            std::copy(_data, _data + _size, _inline);
+            traits::deallocate(_alloc, _buf, _cap);
+            _buf  = _inline;
+            _data = _inline;
+            _cap  = N;
+        } else {
+            reallocate(_size, 0);
+        }
+    }
+
+private:
+    // make count free entries at one end, moving the live entries inside the buffer
+    // while at least half of them would still be free afterwards and reallocating
+    // otherwise; each side keeps at most half of the spare room it does not need
+    void make_room(const bool at_front, const size_t count) {
+        const size_t need = _size + count;
+        size_t       cap  = _cap;
+        if (need + _size / 2 > cap) { cap = std::max(2 * need, N); }
+        const size_t spare = cap - need;
+        const size_t front = at_front ? spare + count - std::min(back_room(), spare / 2)
+                                      : std::min(front_room(), spare / 2);
+        if (cap == _cap) {
+            relocate(front);
+        } else {
+            reallocate(cap, front);
+        }
+    }
+
+    void relocate(const size_t front) noexcept {
+        P* target = _buf + front;
+        if (target < _data) {
+            std::copy(_data, _data + _size, target);
+        } else if (target > _data) {
+            std::copy_backward(_data, _data + _size, target + _size);
+        }
+        _data = target;
+    }
+
+    void reallocate(const size_t n, const size_t front) {
+        P* fresh = traits::allocate(_alloc, n);
+        std::copy(_data, _data + _size, fresh + front);
+        release();
+        _buf  = fresh;
+        _data = fresh + front;
+        _cap  = n;
+    }
+
+    void release() noexcept {
+        if (_buf != _inline) { traits::deallocate(_alloc, _buf, _cap); }
+        _buf  = _inline;
+        _data = _inline;
+        _cap  = N;
+    }
+
+    void steal(ptr_table& other) noexcept {
+        if (other._buf == other._inline) {
+            std::copy(other._data, other._data + other._size, _inline);
+        } else {
+            _buf  = other._buf;
+            _data = other._data;
+            _cap  = other._cap;
+        }
+        _size       = other._size;
+        other._buf  = other._inline;
+        other._data = other._inline;
+        other._cap  = N;
+        other._size = 0;
+    }
+};
+}   // namespace detail
+
+template<typename T, typename Alloc = std::allocator<T>>
 class pyvec {
 public:
     using value_type      = T;
@@ -44,10 +693,14 @@ public:
     using const_pointer   = const T*;
     using size_type       = std::size_t;
     using difference_type = std::ptrdiff_t;
+    using allocator_type  = Alloc;
 
 private:
+    // chunks, the pointer table and the control blocks all allocate through Alloc
     template<typename U>
-    using vec = std::vector<U>;
+    using alloc_of = typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+    template<typename U>
+    using vec = std::vector<U, alloc_of<U>>;
     template<typename U>
     using shared = std::shared_ptr<U>;
 
@@ -55,21 +708,79 @@ private:
      *  Private Data
      */
     static constexpr size_t min_chunk_size = 64;
+    // pointers kept inline, also the size of the first chunk
+    static constexpr size_t small_size = 8;
+    // below this size the comparison sort wins over radix passes
+    static constexpr size_t radix_threshold = 256;
+    // smallest run handed to a thread by the parallel algorithms
+    static constexpr size_t parallel_min_block = 4096;
+    // shorter contiguous runs are searched through the pointer table instead
+    static constexpr size_t min_search_span = 2 * detail::search_block;
+    static constexpr size_t page_size       = 4096;
+    // elements an appender collects before it publishes them
+    static constexpr size_t append_batch = 1024;
+
+    static constexpr size_type no_chunk = static_cast<size_type>(-1);
+
+    // chunk list and its bookkeeping in one control block, shared by shallow copies
+    // and aliased by shared<T> handles
+    struct storage : std::enable_shared_from_this<storage> {
+        vec<vec<T>> chunks;
+        size_type   capacity = 0;
+        // chunk appended to most recently, never listed in the free index
+        size_type last = no_chunk;
+        // free index: buckets[c] holds chunks that had [2^c, 2^(c+1)) free slots when filed,
+        // bit c of filled marks a non-empty bucket; free space only shrinks, so entries are
+        // re-filed lazily when they are looked at
+        vec<vec<size_type>> buckets;
+        uint64_t            filled = 0;
+        // copy-on-write: blocks still holding elements this one points into
+        vec<shared<storage>> parents;
+        // serializes concurrent appenders publishing into the owner
+        std::mutex append_lock;
+        // memory the chunks do not own but elements live in, e.g. a mapped file
+        vec<shared<void>> external;
+        // always present so the layout does not depend on PYVEC_COUNTERS, only the counting does
+        size_type chunk_allocations = 0;
+        size_type chunk_scans       = 0;
+
+        explicit storage(const Alloc& alloc) :
+            chunks(alloc), buckets(alloc), parents(alloc), external(alloc) {}
+
+        // a long copy-on-write chain is released block by block instead of recursively
+        ~storage() {
+            auto pending = std::move(parents);
+            while (!pending.empty()) {
+                auto block = std::move(pending.back());
+                pending.pop_back();
+                if (block.use_count() != 1) { continue; }
+                for (auto& parent : block->parents) { pending.push_back(std::move(parent)); }
+                block->parents.clear();
+            }
+        }
+    };
 
-    shared<vec<vec<T>>> _resources;
-    vec<pointer>        _ptrs;
-    shared<size_type>   _capacity;
-    size_type           _chunk_pivot = 0;
-    vec<T>*             _last_chunk  = nullptr;
+    using table = detail::ptr_table<pointer, alloc_of<pointer>, small_size>;
 
+    using index_type = detail::hash_index<T, Alloc>;
 
-    struct slice_native {
-        size_t    start, num_steps;
-        ptrdiff_t step;
+    // created on the first insertion, empty pyvecs own no chunks
+    shared<storage> _storage;
+    table           _ptrs;
+    double          _compact_ratio = 0;
+    growth_policy   _growth;
+    bool            _relayout_sort = false;
+    bool            _cow           = false;
+    bool            _assume_sorted = false;
+    // true: all elements are contiguous in logical order, false: unknown
+    mutable detail::cached_flag _dense = true;
+    // true: ascending by operator< as far as this instance can tell, false: unknown
+    mutable detail::cached_flag _sorted = true;
+    // opt-in, brought up to date by the first lookup after it is invalidated
+    shared<index_type> _index;
 
-        slice_native(size_t start, size_t num_steps, ptrdiff_t step) :
-            start(start), num_steps(num_steps), step(step) {}
-    };
+
+    using slice_native = detail::slice_native;
 
 public:
     /*
@@ -79,7 +790,15 @@ public:
     class iterator;
     class const_iterator;
     class shared_iterator;
-    using pointer_iterator         = typename std::vector<pointer>::iterator;
+    class borrowed_iterator;
+    class ref;
+    class concurrent_appender;
+    template<typename V>
+    class view_of;
+    // lazy slice over the pointer table, see view()
+    using view_type       = view_of<T>;
+    using const_view_type = view_of<const T>;
+    using pointer_iterator         = pointer*;
     using reverse_iterator         = std::reverse_iterator<iterator>;
     using reverse_pointer_iterator = std::reverse_iterator<pointer_iterator>;
 
@@ -95,13 +814,29 @@ public:
     // deepcopy when extend
     template<typename InputIt>
     void extend(is_input_iterator_t<InputIt> first, InputIt last);
-    void extend(const pyvec<T>& other);
+    void extend(const pyvec<T, Alloc>& other);
+    void extend(std::initializer_list<T> il);
+    // takes over the chunks of a uniquely owned pyvec, moves its elements otherwise
+    void extend(pyvec<T, Alloc>&& other);
+    // adopts the vector's buffer as a chunk when the allocators agree
+    void extend(vec<T>&& other);
+    // adopts elements owned elsewhere, e.g. a numpy array; they stay where they are and
+    // keepalive is held as long as anything uses the storage, its deleter owns the elements
+    void extend(std::span<T> elements, shared<void> keepalive);
+    // adopts the first count elements of buffer, which is freed along with the storage
+    void extend(std::unique_ptr<T[]> buffer, size_type count);
 
     void insert(difference_type index, const T& value);
     void insert(difference_type index, const shared<T>& value);
 
     shared<T> pop(difference_type index = -1);
 
+    // deque-style ends: the pointer table keeps headroom in front as well,
+    // so these are amortized O(1) like append and pop()
+    void      appendleft(const T& value);
+    void      appendleft(const shared<T>& value);
+    shared<T> popleft();
+
     void remove(const T& value);
     void remove(const shared<T>& value);
 
@@ -109,28 +844,73 @@ public:
 
     void clear();
 
-    pyvec<T> copy();
+    pyvec<T, Alloc> copy();
 
-    pyvec<T> deepcopy();
+    pyvec<T, Alloc> deepcopy();
 
     void sort(bool reverse = false);
     template<typename Key>
     void sort(Key key, bool reverse);
+    // the *_shared variants pass a ref; a callback taking shared<T> converts it and pays
+    // for the reference count, one taking ref or auto does not
     template<typename Key>
     void sort_shared(Key key, bool reverse);
 
+    // decorate-sort-undecorate, key is evaluated exactly once per element
+    template<typename Key>
+    void sort_cached(Key key, bool reverse);
+    template<typename Key>
+    void sort_shared_cached(Key key, bool reverse);
+
+    // sort per-thread runs concurrently and merge them with gfx::timmerge, the result is
+    // identical to sort(); n_threads == 0 uses std::thread::hardware_concurrency()
+    // key must be safe to call from several threads at once
+    void sort_parallel(bool reverse = false, size_type n_threads = 0);
+    template<typename Key>
+    void sort_parallel(Key key, bool reverse, size_type n_threads = 0);
+
+    // ascending order by operator< is tracked: it is known after sort() or a successful
+    // is_sorted(), kept by appends in order, insort(), merge() and removals, and forgotten
+    // once anything is written or mutable access is handed out. Elements that are neither
+    // ordered nor equal to their neighbours (NaN) keep it unknown. Lookups and sort() only
+    // rely on it after set_assume_sorted(true)
     [[nodiscard]] bool is_sorted(bool reverse = false) const;
     template<typename Key>
     [[nodiscard]] bool is_sorted(Key key, bool reverse) const;
     template<typename Key>
     [[nodiscard]] bool is_sorted_shared(Key key, bool reverse) const;
 
+    // for a list sorted by operator<: where value would be inserted before its equals, or after
+    [[nodiscard]] size_type bisect_left(const T& value) const;
+    [[nodiscard]] size_type bisect_right(const T& value) const;
+    // insert value after its equals, a sorted list stays sorted
+    void insort(const T& value);
+
+    // merge a sorted list into this sorted one with gfx::timmerge, equal elements of this list
+    // come first; when either is not sorted, the extended list is sorted as a whole instead
+    void merge(const pyvec<T, Alloc>& other);
+    void merge(pyvec<T, Alloc>&& other);
+
     template<typename Func>
     void filter(Func func);
 
     template<typename Func>
     void filter_shared(Func func);
 
+    // filter with func evaluated concurrently on blocks of the table, the order of the kept
+    // elements matches filter; func must be safe to call from several threads
+    template<typename Func>
+    void filter_parallel(Func func, size_type n_threads = 0);
+    template<typename Func>
+    void filter_shared_parallel(Func func, size_type n_threads = 0);
+
+    // new pyvec holding func(x) for every element x, in order
+    template<typename Func>
+    auto map(Func func) const;
+    // map with func evaluated concurrently on blocks, the result has the same order
+    template<typename Func>
+    auto map_parallel(Func func, size_type n_threads = 0) const;
+
     size_t index(
         const T&                       value,
         std::optional<difference_type> start = std::nullopt,
@@ -153,12 +933,22 @@ public:
 
     template<typename InputIt>
     void setitem(const slice& t_slice, is_input_iterator_t<InputIt> first, InputIt last);
-    void setitem(const slice& t_slice, const pyvec<T>& other);
+    void setitem(const slice& t_slice, const pyvec<T, Alloc>& other);
 
     shared<T> getitem(difference_type index);
+    // like getitem without touching a reference count, see ref
+    ref borrow(difference_type index);
 
     // shallow copy when slicing
-    pyvec<T> getitem(const slice& t_slice);
+    pyvec<T, Alloc> getitem(const slice& t_slice);
+
+    // std::ranges view of a (strided) slice that reads the pointer table in place, without
+    // allocating; it borrows the table like std::span and is invalidated by any change to it,
+    // materialize() turns it into a pyvec sharing the storage like getitem(slice)
+    view_type                     view();
+    view_type                     view(const slice& t_slice);
+    [[nodiscard]] const_view_type view() const;
+    [[nodiscard]] const_view_type view(const slice& t_slice) const;
 
     void delitem(difference_type index);
 
@@ -174,30 +964,38 @@ public:
     // default constructor
     pyvec();
 
+    explicit pyvec(const Alloc& alloc);
+
     // constructor with iterators
     template<typename InputIt>
-    pyvec(is_input_iterator_t<InputIt> first, InputIt last);
+    pyvec(is_input_iterator_t<InputIt> first, InputIt last, const Alloc& alloc = Alloc());
 
     // deep copy constructor
-    pyvec(const pyvec<T>& other);
+    pyvec(const pyvec<T, Alloc>& other);
+    pyvec(const pyvec<T, Alloc>& other, const Alloc& alloc);
 
-    explicit pyvec(const vec<T>& other);
+    explicit pyvec(const vec<T>& other, const Alloc& alloc = Alloc());
 
     // move constructor
-    pyvec(pyvec<T>&& other) noexcept;
+    pyvec(pyvec<T, Alloc>&& other) noexcept;
 
+    // adopts the vector's buffer as a chunk together with its allocator
     explicit pyvec(vec<T>&& other);
 
+    // adopts externally owned elements without copying, see extend(std::span<T>, shared<void>)
+    pyvec(std::span<T> elements, shared<void> keepalive, const Alloc& alloc = Alloc());
+    pyvec(std::unique_ptr<T[]> buffer, size_type count, const Alloc& alloc = Alloc());
+
     // initializer list constructor
-    pyvec(std::initializer_list<T> il);
+    pyvec(std::initializer_list<T> il, const Alloc& alloc = Alloc());
 
     // destructor
     ~pyvec() = default;
 
     // operator =
-    pyvec<T>& operator=(const pyvec<T>& other);
-    pyvec<T>& operator=(pyvec<T>&& other) noexcept;
-    pyvec<T>& operator=(std::initializer_list<T> il);
+    pyvec<T, Alloc>& operator=(const pyvec<T, Alloc>& other);
+    pyvec<T, Alloc>& operator=(pyvec<T, Alloc>&& other) noexcept;
+    pyvec<T, Alloc>& operator=(std::initializer_list<T> il);
 
     // assign
     void assign(size_type count, const T& value);
@@ -207,6 +1005,8 @@ public:
 
     void assign(std::initializer_list<T> il);
 
+    [[nodiscard]] allocator_type get_allocator() const;
+
     /*
      *  Vector-Like Element Access
      */
@@ -233,6 +1033,8 @@ public:
     const_iterator           begin() const;
     const_iterator           cbegin() const;
     shared_iterator          sbegin();
+    // like sbegin(), dereferencing gives a ref and leaves the reference count alone
+    borrowed_iterator        bbegin();
     pointer_iterator         pbegin();
     reverse_iterator         rbegin();
     reverse_pointer_iterator rpbegin();
@@ -242,6 +1044,7 @@ public:
     const_iterator           end() const;
     const_iterator           cend() const;
     shared_iterator          send();
+    borrowed_iterator        bend();
     pointer_iterator         pend();
     reverse_iterator         rend();
     reverse_pointer_iterator rpend();
@@ -254,10 +1057,25 @@ public:
 
     [[nodiscard]] size_type size() const;
 
+    // make room for new_cap elements in total: the pointer table and the chunk appended to
+    // are sized so that the next new_cap - size() appends do not allocate
     void reserve(size_type new_cap);
 
+    // element slots of all chunks, shared with shallow copies
     [[nodiscard]] size_type capacity() const;
 
+    // appends this instance can take before anything is allocated. Without copy-on-write,
+    // shallow copies sharing the storage compete for the same slots; with it, a shared block
+    // reports 0, the next append detaches to a fresh block
+    [[nodiscard]] size_type free_capacity() const;
+
+    // heap bytes held by the pointer table and the (possibly shared) chunk storage
+    [[nodiscard]] size_type memory_usage() const;
+
+    // chunk and pointer table figures for deciding on compact() or relayout(), O(n)
+    [[nodiscard]] pyvec_stats stats() const;
+
+    // release empty chunks and the unused pointer table, elements are never moved
     void shrink_to_fit();
 
     /*
@@ -298,18 +1116,18 @@ public:
     void resize(size_type count, const T& value);
 
     // swap
-    void swap(pyvec<T>& other) noexcept;
+    void swap(pyvec<T, Alloc>& other) noexcept;
 
     /*
      *  Comparison
      */
 
-    bool operator==(const pyvec<T>& other) const;
-    bool operator!=(const pyvec<T>& other) const;
-    bool operator<(const pyvec<T>& other) const;
-    bool operator<=(const pyvec<T>& other) const;
-    bool operator>(const pyvec<T>& other) const;
-    bool operator>=(const pyvec<T>& other) const;
+    bool operator==(const pyvec<T, Alloc>& other) const;
+    bool operator!=(const pyvec<T, Alloc>& other) const;
+    bool operator<(const pyvec<T, Alloc>& other) const;
+    bool operator<=(const pyvec<T, Alloc>& other) const;
+    bool operator>(const pyvec<T, Alloc>& other) const;
+    bool operator>=(const pyvec<T, Alloc>& other) const;
 
     /*
      *  Pyvec Specific Functions
@@ -317,17 +1135,111 @@ public:
 
     vec<T> collect() const;
 
+    // all elements as one span without copying, throws std::logic_error unless is_dense()
+    [[nodiscard]] std::span<T>       as_span();
+    [[nodiscard]] std::span<const T> as_span() const;
+
+    // call func with std::span<T> over every maximal run of contiguous elements, in order
+    template<typename Func>
+    void for_each_span(Func func);
+    template<typename Func>
+    void for_each_span(Func func) const;
+
+    // move live elements into a fresh dense chunk and free the dead ones
+    // returns false (and does nothing) while the chunks are shared with copies or handles
+    bool compact();
+
+    // compact automatically once live / allocated elements drops below ratio, 0 disables
+    void                 set_compact_threshold(double ratio);
+    [[nodiscard]] double compact_threshold() const;
+
+    // rewrite storage so that element i lives at position i of one contiguous chunk
+    // existing references are invalidated, shared chunks are copied from instead of moved
+    void relayout();
+
+    // whether all elements are stored contiguously in logical order
+    [[nodiscard]] bool is_dense() const;
+
+    // relayout automatically after every sort
+    void               set_relayout_on_sort(bool enable);
+    [[nodiscard]] bool relayout_on_sort() const;
+
+    // treat storage shared with copies as immutable: the first structural change on a shared
+    // instance moves it to storage of its own, existing elements stay shared
+    void               set_copy_on_write(bool enable);
+    [[nodiscard]] bool copy_on_write() const;
+
+    // rely on the tracked order (see is_sorted()): while it is known and no copy, slice or
+    // handle shares the elements, sort() and is_sorted() are O(1) and index / count /
+    // contains / remove binary search. Writes through references taken earlier, even before
+    // the sort, are not seen and make those answers wrong; only enable it when there are none
+    void               set_assume_sorted(bool enable);
+    [[nodiscard]] bool assume_sorted() const;
+
+    // keep a hash index of the values, T needs std::hash. count and contains become O(1)
+    // expected, and so do index and remove while no element moved since the last lookup.
+    // Appends, pops and single inserts, erases and setitem keep it up to date, anything else
+    // (including mutable access to elements) has it rebuilt in O(n) by the next lookup.
+    // Writes through copies sharing the elements or through references kept across a lookup
+    // are not seen, call set_hash_index(true) again after those
+    void               set_hash_index(bool enable);
+    [[nodiscard]] bool hash_index() const;
+
+    // producer handle for one thread: elements are buffered in a chunk of its own and
+    // published to this pyvec batch_size at a time under a lock; create all appenders on the
+    // owning thread and leave the pyvec alone until they are flushed or destroyed
+    concurrent_appender appender(size_type batch_size = append_batch);
+
+    // sizing of chunks allocated from now on, existing chunks are kept
+    void                        set_growth_policy(const growth_policy& policy);
+    [[nodiscard]] growth_policy get_growth_policy() const;
+
+    /*
+     *  Serialization, trivially copyable T only
+     */
+
+    // write the elements in logical order, one write per contiguous run
+    void save(std::ostream& os) const;
+    void save(const std::string& path) const;
+
+    // read everything into a single chunk
+    static pyvec<T, Alloc> load(std::istream& is, const Alloc& alloc = Alloc());
+    static pyvec<T, Alloc> load(const std::string& path, const Alloc& alloc = Alloc());
+
+    // map a saved file privately and point the table straight into it, nothing is copied;
+    // writes stay in this process, the mapping lives as long as anything uses the storage.
+    // falls back to load() where mmap is not available
+    static pyvec<T, Alloc> map_file(const std::string& path, const Alloc& alloc = Alloc());
+
 private:
     /*
      *  Internal Helper Functions
      */
-    void move_assign(pyvec<T>&& other);
+    void move_assign(pyvec<T, Alloc>&& other);
     void move_assign(vec<T>&& other);
 
+    // storage that may be written to, created or detached from copies as needed
     void try_init();
 
+    // nobody else can observe the elements, so they may be moved from
+    [[nodiscard]] bool exclusive() const;
+
+    [[nodiscard]] shared<storage> make_storage() const;
+
+    // points count table entries at count consecutive elements
+    static void link(pointer* target, pointer first, size_type count);
+
     vec<T>& new_chunk(size_type n);
 
+    // size of the next chunk under the growth policy, at least expected_size
+    [[nodiscard]] size_type grown_chunk(size_type expected_size) const;
+
+    // list a chunk with free slots in the free index
+    void file_chunk(size_type index);
+
+    // make chunk index the one appended to, filing the previous one
+    vec<T>& use_chunk(size_type index);
+
     vec<T>& add_chunk(vec<T>&& chunk);
 
     template<typename... Args>
@@ -337,22 +1249,77 @@ private:
 
     size_type insert_empty(const_iterator pos, size_type count);
 
-    [[nodiscard]] size_type pypos(difference_type index) const;
+    void rebuild();
 
-    shared<T> share(size_type index);
+    void finish_sort();
 
-    slice_native build_slice(const slice& t_slice) const;
-};
+    // merge the sorted tail starting at mid into the sorted head, sort all unless sorted
+    void merge_tail(size_type mid, bool sorted);
 
-// Iterator Definition
-template<typename T>
-class pyvec<T>::iterator {
-    friend class pyvec;
-    friend class const_iterator;
-    pointer* _ptr;
+    // keep the entries for which keep(ptr) holds, evaluated on concurrent blocks
+    template<typename Keep>
+    void filter_blocks(Keep keep, size_type n_threads);
 
-public:
-    using value_type        = T;
+    void track_append(const_pointer ptr);
+
+    // forget sortedness unless value, about to be appended, keeps the order
+    void track_order(const T& value);
+
+    // sortedness may be relied on: opted in, known, and no other instance can write the elements
+    [[nodiscard]] bool known_sorted() const { return _assume_sorted && _sorted && exclusive(); }
+
+    // every adjacent pair is in_order, the check behind caching sortedness
+    [[nodiscard]] bool ordered() const;
+
+    // elements may be written through what is handed out, forget what depends on their values
+    void expose_elements();
+
+    // hash index upkeep, no-ops without an index: shifted tells whether the elements behind
+    // pos moved; index_drop is called before the element leaves the table
+    void index_add(const T& value, size_type pos, bool shifted);
+    void index_drop(const T& value, size_type pos, bool shifted);
+    void index_reset();
+    void index_reordered();
+
+    // the entry of value if present, rebuilding what is out of date under the index lock
+    std::optional<detail::hash_entry> index_find(const T& value, bool positions) const;
+
+    void track_insert(size_type idx);
+
+    void track_erase(size_type left, size_type right);
+
+    template<typename Func>
+    bool visit_spans(size_type first, size_type last, Func func) const;
+
+    template<typename SpanFunc, typename GatherFunc>
+    bool visit_runs(size_type first, size_type last, SpanFunc on_span, GatherFunc on_gather) const;
+
+    [[nodiscard]] size_type find_value(const T& value, size_type first, size_type last) const;
+
+    void try_compact();
+
+    [[nodiscard]] size_type pypos(difference_type index) const;
+
+    shared<T> share(size_type index);
+
+    template<typename K>
+    void sort_decorated(std::vector<std::pair<K, pointer>>& decorated, bool reverse);
+
+    template<typename Key>
+    void radix_sort(Key& key, bool reverse);
+
+    slice_native build_slice(const slice& t_slice) const;
+};
+
+// Iterator Definition
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::iterator {
+    friend class pyvec;
+    friend class const_iterator;
+    pointer* _ptr;
+
+public:
+    using value_type        = T;
     using different_type    = std::ptrdiff_t;
     using iterator_category = std::random_access_iterator_tag;
 
@@ -421,8 +1388,8 @@ public:
     bool operator>=(const iterator& other) const { return _ptr >= other._ptr; }
 };
 
-template<typename T>
-class pyvec<T>::const_iterator {
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::const_iterator {
     friend class pyvec;
     const const_pointer* _ptr;
 
@@ -512,11 +1479,11 @@ public:
     bool operator>=(const const_iterator& other) const { return _ptr >= other._ptr; }
 };
 
-template<typename T>
-class pyvec<T>::shared_iterator {
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::shared_iterator {
     friend class pyvec;
-    pointer*            _ptr;
-    shared<vec<vec<T>>> _resources;
+    pointer*        _ptr;
+    shared<storage> _storage;
 
 public:
     using value_type        = T;
@@ -527,13 +1494,13 @@ public:
     shared_iterator()                           = default;
     shared_iterator(const shared_iterator&)     = default;
     shared_iterator(shared_iterator&&) noexcept = default;
-    shared_iterator(pointer* ptr, const shared<vec<vec<T>>>& resources) :
-        _ptr(ptr), _resources(resources) {}
+    shared_iterator(pointer* ptr, const shared<storage>& storage) :
+        _ptr(ptr), _storage(storage) {}
 
     shared_iterator& operator=(const shared_iterator&)     = default;
     shared_iterator& operator=(shared_iterator&&) noexcept = default;
 
-    reference operator*() const { return shared<T>(_resources, *_ptr); }
+    reference operator*() const { return shared<T>(_storage, *_ptr); }
     pointer   operator->() const { return *_ptr; }
 
     shared_iterator& operator+=(difference_type i) {
@@ -569,11 +1536,11 @@ public:
     }
 
     shared_iterator operator+(difference_type i) const {
-        return shared_iterator{_ptr + i, _resources};
+        return shared_iterator{_ptr + i, _storage};
     }
 
     shared_iterator operator-(difference_type i) const {
-        return shared_iterator{_ptr - i, _resources};
+        return shared_iterator{_ptr - i, _storage};
     }
 
     difference_type operator-(const shared_iterator& other) const { return _ptr - other._ptr; }
@@ -587,162 +1554,767 @@ public:
     bool operator>=(const shared_iterator& other) const { return _ptr >= other._ptr; }
 };
 
+// shared_iterator handing out ref instead of shared<T>, valid while the storage is
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::borrowed_iterator {
+    friend class pyvec;
+    pointer* _ptr     = nullptr;
+    storage* _storage = nullptr;
+
+public:
+    using value_type        = T;
+    using reference         = ref;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::random_access_iterator_tag;
+
+    borrowed_iterator() = default;
+    borrowed_iterator(pointer* ptr, storage* block) : _ptr(ptr), _storage(block) {}
+
+    reference operator*() const { return ref(*_ptr, _storage); }
+    pointer   operator->() const { return *_ptr; }
+
+    borrowed_iterator& operator+=(difference_type i) {
+        _ptr += i;
+        return *this;
+    }
+
+    borrowed_iterator& operator-=(difference_type i) {
+        _ptr -= i;
+        return *this;
+    }
+
+    borrowed_iterator& operator++() {
+        ++_ptr;
+        return *this;
+    }
+
+    borrowed_iterator& operator--() {
+        --_ptr;
+        return *this;
+    }
+
+    borrowed_iterator operator++(int) {
+        borrowed_iterator tmp = *this;
+        ++_ptr;
+        return tmp;
+    }
+
+    borrowed_iterator operator--(int) {
+        borrowed_iterator tmp = *this;
+        --_ptr;
+        return tmp;
+    }
+
+    borrowed_iterator operator+(difference_type i) const {
+        return borrowed_iterator{_ptr + i, _storage};
+    }
+
+    borrowed_iterator operator-(difference_type i) const {
+        return borrowed_iterator{_ptr - i, _storage};
+    }
+
+    difference_type operator-(const borrowed_iterator& other) const { return _ptr - other._ptr; }
+
+    // operator <=>
+    bool operator==(const borrowed_iterator& other) const { return _ptr == other._ptr; }
+    bool operator!=(const borrowed_iterator& other) const { return _ptr != other._ptr; }
+    bool operator<(const borrowed_iterator& other) const { return _ptr < other._ptr; }
+    bool operator>(const borrowed_iterator& other) const { return _ptr > other._ptr; }
+    bool operator<=(const borrowed_iterator& other) const { return _ptr <= other._ptr; }
+    bool operator>=(const borrowed_iterator& other) const { return _ptr >= other._ptr; }
+};
+
+template<typename T, typename Alloc>
+template<typename V>
+class pyvec<T, Alloc>::view_of : public std::ranges::view_interface<view_of<V>> {
+    friend class pyvec;
+    using table_pointer = std::conditional_t<std::is_const_v<V>, const pointer*, pointer*>;
+
+    const pyvec*    _owner = nullptr;
+    table_pointer   _base  = nullptr;
+    size_type       _size  = 0;
+    difference_type _step  = 1;
+
+    view_of(const pyvec* owner, table_pointer base, size_type size, difference_type step) :
+        _owner(owner), _base(base), _size(size), _step(step) {}
+
+public:
+    class iterator {
+    public:
+        using value_type        = std::remove_cv_t<V>;
+        using reference         = V&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+
+    private:
+        table_pointer   _base  = nullptr;
+        difference_type _step  = 1;
+        difference_type _index = 0;
+
+    public:
+
+        iterator() = default;
+        iterator(table_pointer base, difference_type step, difference_type index) :
+            _base(base), _step(step), _index(index) {}
+
+        reference operator*() const { return *_base[_index * _step]; }
+        V*        operator->() const { return _base[_index * _step]; }
+        reference operator[](difference_type i) const { return *_base[(_index + i) * _step]; }
+
+        iterator& operator++() {
+            ++_index;
+            return *this;
+        }
+
+        iterator& operator--() {
+            --_index;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++_index;
+            return tmp;
+        }
+
+        iterator operator--(int) {
+            iterator tmp = *this;
+            --_index;
+            return tmp;
+        }
+
+        iterator& operator+=(difference_type i) {
+            _index += i;
+            return *this;
+        }
+
+        iterator& operator-=(difference_type i) {
+            _index -= i;
+            return *this;
+        }
+
+        friend iterator operator+(iterator it, difference_type i) { return it += i; }
+        friend iterator operator+(difference_type i, iterator it) { return it += i; }
+        friend iterator operator-(iterator it, difference_type i) { return it -= i; }
+        friend difference_type operator-(const iterator& a, const iterator& b) {
+            return a._index - b._index;
+        }
+
+        bool operator==(const iterator& other) const { return _index == other._index; }
+        auto operator<=>(const iterator& other) const { return _index <=> other._index; }
+    };
+
+    view_of() = default;
+
+    [[nodiscard]] iterator  begin() const { return iterator(_base, _step, 0); }
+    [[nodiscard]] iterator  end() const { return iterator(_base, _step, _size); }
+    [[nodiscard]] size_type size() const { return _size; }
+
+    // pyvec over the same elements, sharing the owner's storage
+    [[nodiscard]] pyvec materialize() const {
+        pyvec ans(_owner->get_allocator());
+        if (_size == 0) { return ans; }
+        ans._storage = _owner->_storage;
+        ans._cow     = _owner->_cow;
+        ans._ptrs.resize(_size);
+        for (size_type i = 0; i < _size; ++i) { ans._ptrs[i] = _base[i * _step]; }
+        ans._dense  = _size < 2 || (_step == 1 && _owner->_dense);
+        ans._sorted = _size < 2 || (_step > 0 && _owner->_sorted);
+        // either side may now write elements the other one sees
+        _owner->_sorted = false;
+        return ans;
+    }
+};
+
+// borrowed handle to an element: a pointer plus the storage it lives in, so it costs no
+// atomics to create or copy, while converting to shared<T> shares ownership like getitem.
+// it is valid as long as the storage is, which a pyvec left unchanged guarantees
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::ref {
+    friend class pyvec;
+    pointer  _ptr     = nullptr;
+    storage* _storage = nullptr;
+
+    ref(const pointer ptr, storage* block) noexcept : _ptr(ptr), _storage(block) {}
+
+public:
+    using element_type = T;
+
+    ref() = default;
+
+    T&                     operator*() const noexcept { return *_ptr; }
+    T*                     operator->() const noexcept { return _ptr; }
+    [[nodiscard]] T*       get() const noexcept { return _ptr; }
+    explicit               operator bool() const noexcept { return _ptr != nullptr; }
+    [[nodiscard]] shared<T> share() const {
+        return _ptr ? shared<T>(_storage->shared_from_this(), _ptr) : shared<T>();
+    }
+    operator shared<T>() const { return share(); }
+
+    bool operator==(const ref& other) const noexcept { return _ptr == other._ptr; }
+};
+
+template<typename T, typename Alloc>
+class pyvec<T, Alloc>::concurrent_appender {
+    friend class pyvec;
+    pyvec*    _owner = nullptr;
+    vec<T>    _chunk;
+    size_type _batch;
+
+    concurrent_appender(pyvec& owner, const size_type batch) :
+        _owner(&owner), _chunk(owner.get_allocator()), _batch(std::max<size_type>(1, batch)) {
+        owner.try_init();
+    }
+
+public:
+    concurrent_appender(const concurrent_appender&)            = delete;
+    concurrent_appender& operator=(const concurrent_appender&) = delete;
+    concurrent_appender& operator=(concurrent_appender&&)      = delete;
+
+    concurrent_appender(concurrent_appender&& other) noexcept :
+        _owner(std::exchange(other._owner, nullptr)), _chunk(std::move(other._chunk)),
+        _batch(other._batch) {}
+
+    // flushes what is left; should that fail the buffered elements are dropped, call flush()
+    // beforehand to see the error
+    ~concurrent_appender() {
+        try {
+            flush();
+        } catch (...) {}
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (_chunk.capacity() == 0) { _chunk.reserve(_batch); }
+        // the chunk never grows past its reservation, so element addresses are final
+        auto& value = _chunk.emplace_back(std::forward<Args>(args)...);
+        if (_chunk.size() == _chunk.capacity()) { flush(); }
+        return value;
+    }
+
+    // hand the buffered elements over to the pyvec, all of them or none when it throws
+    void flush() {
+        if (_owner == nullptr || _chunk.empty()) { return; }
+        auto&           owner = *_owner;
+        std::lock_guard guard(owner._storage->append_lock);
+        const auto      raw_size = owner._ptrs.size();
+        const auto      count    = _chunk.size();
+        // moving the chunk into the list keeps its buffer
+        const pointer first = _chunk.data();
+        owner.track_append(first);
+        owner._ptrs.resize(raw_size + count);
+        try {
+            owner.add_chunk(std::move(_chunk));
+        } catch (...) {
+            owner._ptrs.resize(raw_size);
+            throw;
+        }
+        owner._sorted = false;
+        owner.index_reset();
+        link(owner._ptrs.data() + raw_size, first, count);
+        _chunk = vec<T>(owner.get_allocator());
+    }
+};
+
 /*
  *  Helper Functions
  */
 
-template<typename T>
-void pyvec<T>::move_assign(pyvec<T>&& other) {
-    _resources   = std::move(other._resources);
-    _ptrs        = std::move(other._ptrs);
-    _chunk_pivot = other._chunk_pivot;
-    _capacity    = std::move(other._capacity);
-    _last_chunk  = other._last_chunk;
-}
-
-template<typename T>
-void pyvec<T>::move_assign(vec<T>&& other) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::move_assign(pyvec<T, Alloc>&& other) {
+    _storage       = std::move(other._storage);
+    _ptrs          = std::move(other._ptrs);
+    _compact_ratio = other._compact_ratio;
+    _growth        = other._growth;
+    _relayout_sort = other._relayout_sort;
+    _cow           = other._cow;
+    _assume_sorted = other._assume_sorted;
+    _dense         = other._dense;
+    _sorted        = other._sorted;
+    _index         = std::move(other._index);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::move_assign(vec<T>&& other) {
     try_init();
     auto& chunk = emplace_chunk(std::move(other));
+    _dense      = true;
+    _sorted     = chunk.size() < 2;
+    index_reset();
     _ptrs.resize(chunk.size());
-    auto       ptr = chunk.data();
-    const auto end = _ptrs.data() + _ptrs.size();
-    for (auto target = _ptrs.data(); target != end; ++target) { *target = ptr++; }
+    link(_ptrs.data(), chunk.data(), chunk.size());
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::try_init() {
+    if (!_storage) {
+        _storage = make_storage();
+    } else if (_cow && _storage.use_count() > 1) {
+        // new elements go to a block of our own, the old one is kept alive for ours
+        // the old block holds on to its own parents, so the blocks form a chain
+        auto fresh = make_storage();
+        fresh->parents.push_back(std::move(_storage));
+        _storage = std::move(fresh);
+    }
 }
 
-template<typename T>
-void pyvec<T>::try_init() {
-    if (!_resources) { _resources = std::make_shared<vec<vec<T>>>(); }
-    if (!_capacity) { _capacity = std::make_shared<size_type>(0); }
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::exclusive() const {
+    if (!_storage || _storage.use_count() > 1) { return false; }
+    if (_storage->parents.empty()) { return true; }
+    // every block up the chain must be held only by the block that detached from it
+    vec<const storage*> pending(1, _storage.get(), get_allocator());
+    while (!pending.empty()) {
+        const storage* block = pending.back();
+        pending.pop_back();
+        for (const auto& parent : block->parents) {
+            if (parent.use_count() > 1) { return false; }
+            pending.push_back(parent.get());
+        }
+    }
+    return true;
 }
 
-template<typename T>
-std::vector<T>& pyvec<T>::new_chunk(size_type n) {
-    _resources->emplace_back();
-    auto& chunk = _resources->back();
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::make_storage() const -> shared<storage> {
+    // one allocation for the chunk list, its bookkeeping and the reference counts
+    return std::allocate_shared<storage>(get_allocator(), get_allocator());
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::link(pointer* target, const pointer first, const size_type count) {
+    for (size_type i = 0; i < count; ++i) { target[i] = first + i; }
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::new_chunk(size_type n) -> vec<T>& {
+    // the chunk is moved in before reserving, so its buffer comes from the list's allocator
+    _storage->chunks.push_back(vec<T>(get_allocator()));
+    auto& chunk = _storage->chunks.back();
     chunk.reserve(n);
-    *_capacity += n;
+    _storage->capacity += chunk.capacity();
+    PYVEC_COUNT(_storage->chunk_allocations);
     return chunk;
 }
 
-template<typename T>
-std::vector<T>& pyvec<T>::add_chunk(vec<T>&& chunk) {
-    *_capacity += chunk.capacity();
-    _resources->emplace_back(std::move(chunk));
-    return _resources->back();
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::add_chunk(vec<T>&& chunk) -> vec<T>& {
+    _storage->chunks.push_back(std::move(chunk));
+    _storage->capacity += _storage->chunks.back().capacity();
+    PYVEC_COUNT(_storage->chunk_allocations);
+    file_chunk(_storage->chunks.size() - 1);
+    return _storage->chunks.back();
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename... Args>
-std::vector<T>& pyvec<T>::emplace_chunk(Args&&... args) {
-    _resources->emplace_back(std::forward<Args>(args)...);
-    *_capacity += _resources->back().capacity();
-    return _resources->back();
+auto pyvec<T, Alloc>::emplace_chunk(Args&&... args) -> vec<T>& {
+    _storage->chunks.push_back(vec<T>(std::forward<Args>(args)..., get_allocator()));
+    _storage->capacity += _storage->chunks.back().capacity();
+    PYVEC_COUNT(_storage->chunk_allocations);
+    file_chunk(_storage->chunks.size() - 1);
+    return _storage->chunks.back();
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::grown_chunk(const size_type expected_size) const -> size_type {
+    // tiny lists start in a small chunk, later chunks grow geometrically
+    size_type n = small_size;
+    if (const auto capacity = _storage->capacity; capacity != 0) {
+        const auto grown = static_cast<double>(capacity) * (_growth.factor - 1);
+        n                = std::max(min_chunk_size, static_cast<size_type>(grown));
+    }
+    if (_growth.page_align) {
+        const auto bytes = (n * sizeof(T) + page_size - 1) / page_size * page_size;
+        n                = std::max<size_type>(1, bytes / sizeof(T));
+    }
+    if (_growth.max_chunk_bytes != 0) {
+        n = std::min(n, std::max<size_type>(1, _growth.max_chunk_bytes / sizeof(T)));
+    }
+    return std::max(n, expected_size);
 }
 
-template<typename T>
-std::vector<T>& pyvec<T>::suitable_chunk(size_type expected_size) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::file_chunk(const size_type index) {
+    auto&      store     = *_storage;
+    const auto remaining = store.chunks[index].capacity() - store.chunks[index].size();
+    if (remaining == 0) { return; }
+    const auto c = static_cast<size_type>(std::bit_width(remaining) - 1);
+    if (store.buckets.size() <= c) { store.buckets.resize(c + 1); }
+    store.buckets[c].push_back(index);
+    store.filled |= uint64_t{1} << c;
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::use_chunk(const size_type index) -> vec<T>& {
+    auto& store = *_storage;
+    if (store.last != no_chunk && store.last != index) { file_chunk(store.last); }
+    store.last = index;
+    return store.chunks[index];
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::suitable_chunk(size_type expected_size) -> vec<T>& {
     if (expected_size == 0) { throw std::invalid_argument("pyvec: expected_size == 0"); }
-    if (_last_chunk != nullptr) {
-        const auto remaining = _last_chunk->capacity() - _last_chunk->size();
-        if (remaining >= expected_size) { return *_last_chunk; }
-    } else {
-        try_init();
+    try_init();
+    auto& store = *_storage;
+    if (store.last != no_chunk) {
+        auto&      last      = store.chunks[store.last];
+        const auto remaining = last.capacity() - last.size();
+        if (remaining >= expected_size) { return last; }
     }
 
-    vec<T>*    ans    = nullptr;
-    bool       update = true;
-    const auto end    = _resources->end();
-    const auto begin  = _resources->begin();
-
-    for (auto iter = _resources->begin() + _chunk_pivot; iter != end; ++iter) {
-        vec<T>&         chunk     = *iter;
-        const size_type remaining = chunk.capacity() - chunk.size();
-        _chunk_pivot              = (update & (remaining == 0)) ? iter - begin + 1 : _chunk_pivot;
-        if (remaining >= expected_size) {
-            ans = &chunk;
-            break;
-        } else if (remaining > 0) {
-            update = false;
-        }
+    // every chunk in a bucket at or above ceil(log2(expected_size)) is large enough
+    const auto fit = static_cast<size_type>(std::bit_width(expected_size - 1));
+    while (fit < 64 && (store.filled >> fit) != 0) {
+        const auto c      = fit + std::countr_zero(store.filled >> fit);
+        auto&      bucket = store.buckets[c];
+        const auto index  = bucket.back();
+        bucket.pop_back();
+        PYVEC_COUNT(store.chunk_scans);
+        if (bucket.empty()) { store.filled &= ~(uint64_t{1} << c); }
+        const auto& chunk = store.chunks[index];
+        if (chunk.capacity() - chunk.size() >= expected_size) { return use_chunk(index); }
+        // filled since it was filed, move it down to its current class
+        file_chunk(index);
     }
-    if (ans == nullptr) {
-        const auto expanded = std::max(expected_size, std::max(*_capacity, min_chunk_size));
-        ans                 = &new_chunk(expanded);
-    }
-    _last_chunk = ans;
-    return *ans;
+    new_chunk(grown_chunk(expected_size));
+    // an index stays valid when the chunk list reallocates
+    return use_chunk(store.chunks.size() - 1);
 }
 
-template<typename T>
-size_t pyvec<T>::insert_empty(const const_iterator pos, const size_type count) {
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::insert_empty(const const_iterator pos, const size_type count) {
     const difference_type idx = std::distance(cbegin(), pos);
     if (idx > _ptrs.size()) { throw std::out_of_range("pyvec::insert_empty"); }
-    const size_type raw_size = _ptrs.size();
-    _ptrs.resize(_ptrs.size() + count);
-    for (difference_type i = raw_size - 1; i >= idx; --i) { _ptrs[i + count] = _ptrs[i]; }
+    if (static_cast<size_type>(idx) != _ptrs.size()) { _dense = false; }
+    _sorted = false;
+    std::fill_n(_ptrs.insert_gap(idx, count), count, nullptr);
     return idx;
 }
 
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::rebuild() {
+    vec<T> dense(get_allocator());
+    dense.reserve(_ptrs.size());
+    if (exclusive()) {
+        for (auto ptr : _ptrs) { dense.push_back(std::move(*ptr)); }
+        _storage->chunks.clear();
+        _storage->capacity = 0;
+        _storage->last     = no_chunk;
+        _storage->buckets.clear();
+        _storage->filled = 0;
+        _storage->parents.clear();
+        _storage->external.clear();
+    } else {
+        // copies or handles still use the old chunks, leave them untouched
+        for (auto ptr : _ptrs) { dense.push_back(*ptr); }
+        _storage = make_storage();
+    }
+    _ptrs.shrink_to_fit();
+    _dense       = true;
+    if (dense.empty()) { return; }
+    auto& chunk = add_chunk(std::move(dense));
+    link(_ptrs.data(), chunk.data(), chunk.size());
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::try_compact() {
+    if (_compact_ratio <= 0 || !exclusive()) { return; }
+    size_type allocated = 0;
+    for (const auto& chunk : _storage->chunks) { allocated += chunk.size(); }
+    if (allocated < min_chunk_size) { return; }
+    if (static_cast<double>(_ptrs.size()) < _compact_ratio * static_cast<double>(allocated)) {
+        rebuild();
+    }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::track_append(const const_pointer ptr) {
+    if (_dense && !_ptrs.empty() && _ptrs.back() + 1 != ptr) { _dense = false; }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::track_order(const T& value) {
+    if constexpr (detail::less_comparable_v<T>) {
+        if (_sorted && !_ptrs.empty() && !detail::in_order(*_ptrs.back(), value)) {
+            _sorted = false;
+        }
+    } else {
+        _sorted = false;
+    }
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::ordered() const {
+    if constexpr (detail::less_comparable_v<T>) {
+        const auto broken = std::adjacent_find(
+            _ptrs.begin(), _ptrs.end(),
+            [](const const_pointer a, const const_pointer b) { return !detail::in_order(*a, *b); }
+        );
+        return broken == _ptrs.end();
+    } else {
+        return _ptrs.size() < 2;
+    }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::expose_elements() {
+    _sorted = false;
+    index_reset();
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::index_add(const T& value, const size_type pos, const bool shifted) {
+    if constexpr (detail::hashable_v<T>) {
+        if (!_index || !_index->counted) { return; }
+        auto& entry = _index->entries[value];
+        if (entry.count++ == 0 || pos < entry.first) { entry.first = pos; }
+        if (shifted) { _index->positioned = false; }
+    }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::index_drop(const T& value, const size_type pos, const bool shifted) {
+    if constexpr (detail::hashable_v<T>) {
+        if (!_index || !_index->counted) { return; }
+        const auto it = _index->entries.find(value);
+        if (it == _index->entries.end()) { return index_reset(); }
+        if (--it->second.count == 0) {
+            _index->entries.erase(it);
+        } else if (it->second.first == pos) {
+            // the next occurrence is not known
+            _index->positioned = false;
+        }
+        if (shifted) { _index->positioned = false; }
+    }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::index_reset() {
+    if constexpr (detail::hashable_v<T>) {
+        // entries are only cleared by the rebuild, this runs on every mutable access
+        if (_index) { _index->counted = _index->positioned = false; }
+    }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::index_reordered() {
+    if constexpr (detail::hashable_v<T>) {
+        if (_index) { _index->positioned = false; }
+    }
+}
+
+template<typename T, typename Alloc>
+std::optional<detail::hash_entry>
+pyvec<T, Alloc>::index_find(const T& value, const bool positions) const {
+    auto&           index = *_index;
+    std::lock_guard guard(index.lock);
+    if (!index.counted || (positions && !index.positioned)) {
+        index.entries.clear();
+        for (size_type i = 0; i < _ptrs.size(); ++i) {
+            auto& entry = index.entries[*_ptrs[i]];
+            if (entry.count++ == 0) { entry.first = i; }
+        }
+        index.counted    = true;
+        index.positioned = true;
+    }
+    const auto it = index.entries.find(value);
+    if (it == index.entries.end()) { return std::nullopt; }
+    return it->second;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::track_insert(const size_type idx) {
+    // insert_empty already forgot density for inserts in the middle
+    if (_dense && idx > 0 && _ptrs[idx - 1] + 1 != _ptrs[idx]) { _dense = false; }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::track_erase(const size_type left, const size_type right) {
+    // dropping a prefix or a suffix of a dense table keeps it dense
+    if (left != 0 && right != _ptrs.size()) { _dense = false; }
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+bool pyvec<T, Alloc>::visit_spans(const size_type first, const size_type last, Func func) const {
+    if (first >= last) { return false; }
+    if (_dense) { return func(std::span<T>(_ptrs[first], last - first), first); }
+    size_type start = first;
+    for (size_type i = first + 1; i < last; ++i) {
+        if (_ptrs[i] != _ptrs[i - 1] + 1) {
+            if (func(std::span<T>(_ptrs[start], i - start), start)) { return true; }
+            start = i;
+        }
+    }
+    return func(std::span<T>(_ptrs[start], last - start), start);
+}
+
+// like visit_spans, but neighbouring runs shorter than min_search_span are merged and passed to
+// on_gather as a range of the pointer table
+template<typename T, typename Alloc>
+template<typename SpanFunc, typename GatherFunc>
+bool pyvec<T, Alloc>::visit_runs(
+    const size_type first, const size_type last, SpanFunc on_span, GatherFunc on_gather
+) const {
+    if (first >= last) { return false; }
+    if (_dense) { return on_span(std::span<T>(_ptrs[first], last - first), first); }
+    const auto gather = [&](const size_type left, const size_type right) {
+        return left < right && on_gather(std::span<const pointer>(&_ptrs[left], right - left), left);
+    };
+    size_type gather_start = first;
+    size_type start        = first;
+    for (size_type i = first + 1; i <= last; ++i) {
+        if (i != last && _ptrs[i] == _ptrs[i - 1] + 1) { continue; }
+        if (i - start >= min_search_span) {
+            if (gather(gather_start, start)) { return true; }
+            if (on_span(std::span<T>(_ptrs[start], i - start), start)) { return true; }
+            gather_start = i;
+        }
+        start = i;
+    }
+    return gather(gather_start, last);
+}
+
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::size_type pyvec<T, Alloc>::find_value(
+    const T& value, const size_type first, const size_type last
+) const {
+    if constexpr (detail::hashable_v<T>) {
+        if (_index) {
+            const auto entry = index_find(value, true);
+            if (!entry || entry->first >= last) { return last; }
+            if (entry->first >= first) { return entry->first; }
+            // the first occurrence lies before the range, search it
+        }
+    }
+    if constexpr (detail::less_comparable_v<T>) {
+        if (known_sorted()) {
+            // the first equal element is among those equivalent to value
+            auto it = std::lower_bound(
+                _ptrs.begin() + first, _ptrs.begin() + last, value,
+                [](const const_pointer a, const T& b) { return *a < b; }
+            );
+            for (; it != _ptrs.begin() + last && !(value < **it); ++it) {
+                if (**it == value) { return it - _ptrs.begin(); }
+            }
+            return last;
+        }
+    }
+    size_type ans = last;
+    if constexpr (std::is_arithmetic_v<T>) {
+        visit_runs(
+            first,
+            last,
+            [&](std::span<T> span, const size_type offset) {
+                const auto pos = detail::find_equal(span.data(), span.size(), value);
+                ans            = offset + pos;
+                return pos != span.size();
+            },
+            [&](std::span<const pointer> ptrs, const size_type offset) {
+                const auto pos = detail::find_equal_gather(ptrs.data(), ptrs.size(), value);
+                ans            = offset + pos;
+                return pos != ptrs.size();
+            }
+        );
+    } else {
+        visit_spans(first, last, [&](std::span<T> span, const size_type offset) {
+            const auto it = std::find(span.begin(), span.end(), value);
+            ans           = offset + (it - span.begin());
+            return it != span.end();
+        });
+    }
+    return ans;
+}
+
 /*
  *  Constructor
  */
 
-template<typename T>
-pyvec<T>::pyvec() {
-    assign({});
-}
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec() : pyvec(Alloc()) {}
 
-template<typename T>
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(const Alloc& alloc) : _ptrs(alloc) {}
+
+template<typename T, typename Alloc>
 template<typename InputIt>
-pyvec<T>::pyvec(is_input_iterator_t<InputIt> first, InputIt last) {
+pyvec<T, Alloc>::pyvec(is_input_iterator_t<InputIt> first, InputIt last, const Alloc& alloc) :
+    _ptrs(alloc) {
     assign(first, last);
 }
 
-template<typename T>
-pyvec<T>::pyvec(const std::vector<T>& other) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(const vec<T>& other, const Alloc& alloc) : _ptrs(alloc) {
     assign(other.begin(), other.end());
 }
 
-template<typename T>
-pyvec<T>::pyvec(const pyvec<T>& other) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(const pyvec<T, Alloc>& other) :
+    _ptrs(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator())
+    ) {
     assign(other.begin(), other.end());
+    _sorted = other._sorted;
 }
 
-template<typename T>
-pyvec<T>::pyvec(std::initializer_list<T> il) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(const pyvec<T, Alloc>& other, const Alloc& alloc) : _ptrs(alloc) {
+    assign(other.begin(), other.end());
+    _sorted = other._sorted;
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(std::initializer_list<T> il, const Alloc& alloc) : _ptrs(alloc) {
     assign(il);
 }
 
-template<typename T>
-pyvec<T>::pyvec(pyvec<T>&& other) noexcept {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(pyvec<T, Alloc>&& other) noexcept : _ptrs(other._ptrs.get_allocator()) {
     move_assign(std::move(other));
 }
 
-template<typename T>
-pyvec<T>::pyvec(std::vector<T>&& other) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(vec<T>&& other) : _ptrs(other.get_allocator()) {
     move_assign(std::move(other));
 }
 
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(const std::span<T> elements, shared<void> keepalive, const Alloc& alloc) :
+    _ptrs(alloc) {
+    extend(elements, std::move(keepalive));
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc>::pyvec(std::unique_ptr<T[]> buffer, const size_type count, const Alloc& alloc) :
+    _ptrs(alloc) {
+    extend(std::move(buffer), count);
+}
+
 /*
  *  Operator =
  */
 
-template<typename T>
-pyvec<T>& pyvec<T>::operator=(const pyvec<T>& other) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>& pyvec<T, Alloc>::operator=(const pyvec<T, Alloc>& other) {
     if (this == &other) { return *this; }
     assign(other.begin(), other.end());
+    _sorted = other._sorted;
     return *this;
 }
 
-template<typename T>
-pyvec<T>& pyvec<T>::operator=(std::initializer_list<T> il) {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>& pyvec<T, Alloc>::operator=(std::initializer_list<T> il) {
     assign(il);
     return *this;
 }
 
-template<typename T>
-pyvec<T>& pyvec<T>::operator=(pyvec<T>&& other) noexcept {
+template<typename T, typename Alloc>
+pyvec<T, Alloc>& pyvec<T, Alloc>::operator=(pyvec<T, Alloc>&& other) noexcept {
     move_assign(std::move(other));
     return *this;
 }
@@ -751,76 +2323,88 @@ pyvec<T>& pyvec<T>::operator=(pyvec<T>&& other) noexcept {
  *  Assign
  */
 
-template<typename T>
-void pyvec<T>::assign(size_type count, const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::assign(size_type count, const T& value) {
     try_init();
     auto& chunk = emplace_chunk(count, value);
+    _dense      = true;
+    _sorted     = count < 2 || detail::in_order(value, value);   // all equal
+    index_reset();
     _ptrs.resize(chunk.size());
-    auto       ptr = chunk.data();
-    const auto end = _ptrs.data() + _ptrs.size();
-    for (auto target = _ptrs.data(); target != end; ++target) { *target = ptr++; }
+    link(_ptrs.data(), chunk.data(), chunk.size());
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<class InputIt>
-void pyvec<T>::assign(is_input_iterator_t<InputIt> first, InputIt last) {
+void pyvec<T, Alloc>::assign(is_input_iterator_t<InputIt> first, InputIt last) {
+    _dense  = true;
+    _sorted = true;
+    index_reset();
+    if (first == last) { return _ptrs.clear(); }
     try_init();
-    if(first == last) { return; }
     auto& chunk = emplace_chunk(first, last);
+    _sorted     = chunk.size() < 2;
     _ptrs.resize(chunk.size());
-    auto       ptr = chunk.data();
-    const auto end = _ptrs.data() + _ptrs.size();
-    for (auto target = _ptrs.data(); target != end; ++target) { *target = ptr++; }
+    link(_ptrs.data(), chunk.data(), chunk.size());
 }
 
-template<typename T>
-void pyvec<T>::assign(std::initializer_list<T> il) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::assign(std::initializer_list<T> il) {
     assign(il.begin(), il.end());
 }
 
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::allocator_type pyvec<T, Alloc>::get_allocator() const {
+    return allocator_type(_ptrs.get_allocator());
+}
+
 /*
  *  Vector-Like Element Access
  */
 
-template<typename T>
-const T& pyvec<T>::at(size_t pos) const {
+template<typename T, typename Alloc>
+const T& pyvec<T, Alloc>::at(size_t pos) const {
     if (pos >= size()) { throw std::out_of_range("pyvec::at"); }
     return *(_ptrs[pos]);
 }
 
-template<typename T>
-T& pyvec<T>::at(size_t pos) {
+template<typename T, typename Alloc>
+T& pyvec<T, Alloc>::at(size_t pos) {
+    expose_elements();
     if (pos >= size()) { throw std::out_of_range("pyvec::at"); }
     return *(_ptrs[pos]);
 }
 
-template<typename T>
-const T& pyvec<T>::operator[](size_t pos) const {
+template<typename T, typename Alloc>
+const T& pyvec<T, Alloc>::operator[](size_t pos) const {
     return *(_ptrs[pos]);
 }
 
-template<typename T>
-T& pyvec<T>::operator[](size_t pos) {
+template<typename T, typename Alloc>
+T& pyvec<T, Alloc>::operator[](size_t pos) {
+    expose_elements();
     return *(_ptrs[pos]);
 }
 
-template<typename T>
-const T& pyvec<T>::front() const {
+template<typename T, typename Alloc>
+const T& pyvec<T, Alloc>::front() const {
     return *(_ptrs.front());
 }
 
-template<typename T>
-T& pyvec<T>::front() {
+template<typename T, typename Alloc>
+T& pyvec<T, Alloc>::front() {
+    expose_elements();
     return *(_ptrs.front());
 }
 
-template<typename T>
-const T& pyvec<T>::back() const {
+template<typename T, typename Alloc>
+const T& pyvec<T, Alloc>::back() const {
     return *(_ptrs.back());
 }
 
-template<typename T>
-T& pyvec<T>::back() {
+template<typename T, typename Alloc>
+T& pyvec<T, Alloc>::back() {
+    expose_elements();
     return *(_ptrs.back());
 }
 
@@ -828,73 +2412,93 @@ T& pyvec<T>::back() {
  *  Vector-Like Iterators
  */
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::begin() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::begin() {
+    expose_elements();
     return iterator(_ptrs.data());
 }
 
-template<typename T>
-typename pyvec<T>::const_iterator pyvec<T>::begin() const {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::const_iterator pyvec<T, Alloc>::begin() const {
     return const_iterator(_ptrs.data());
 }
 
-template<typename T>
-typename pyvec<T>::const_iterator pyvec<T>::cbegin() const {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::const_iterator pyvec<T, Alloc>::cbegin() const {
     return const_iterator(_ptrs.data());
 }
 
-template<typename T>
-typename pyvec<T>::shared_iterator pyvec<T>::sbegin() {
-    return shared_iterator(_ptrs.data(), _resources);
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::shared_iterator pyvec<T, Alloc>::sbegin() {
+    expose_elements();
+    return shared_iterator(_ptrs.data(), _storage);
 }
 
-template<typename T>
-typename pyvec<T>::pointer_iterator pyvec<T>::pbegin() {
-    return _ptrs.begin();
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::borrowed_iterator pyvec<T, Alloc>::bbegin() {
+    expose_elements();
+    return borrowed_iterator(_ptrs.data(), _storage.get());
 }
 
-template<typename T>
-typename pyvec<T>::reverse_iterator pyvec<T>::rbegin() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::pointer_iterator pyvec<T, Alloc>::pbegin() {
+    _dense = false;   // the pointer table may be rewritten through the iterator
+    expose_elements();
+    return _ptrs.begin();
+}
+
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::reverse_iterator pyvec<T, Alloc>::rbegin() {
     return reverse_iterator(end());
 }
 
-template<typename T>
-typename pyvec<T>::reverse_pointer_iterator pyvec<T>::rpbegin() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::reverse_pointer_iterator pyvec<T, Alloc>::rpbegin() {
     return reverse_pointer_iterator(pend());
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::end() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::end() {
+    expose_elements();
     return iterator(_ptrs.data() + _ptrs.size());
 }
 
-template<typename T>
-typename pyvec<T>::const_iterator pyvec<T>::end() const {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::const_iterator pyvec<T, Alloc>::end() const {
     return const_iterator(_ptrs.data() + _ptrs.size());
 }
 
-template<typename T>
-typename pyvec<T>::const_iterator pyvec<T>::cend() const {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::const_iterator pyvec<T, Alloc>::cend() const {
     return const_iterator(_ptrs.data() + _ptrs.size());
 }
 
-template<typename T>
-typename pyvec<T>::shared_iterator pyvec<T>::send() {
-    return shared_iterator(_ptrs.data() + _ptrs.size(), _resources);
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::shared_iterator pyvec<T, Alloc>::send() {
+    expose_elements();
+    return shared_iterator(_ptrs.data() + _ptrs.size(), _storage);
 }
 
-template<typename T>
-typename pyvec<T>::pointer_iterator pyvec<T>::pend() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::borrowed_iterator pyvec<T, Alloc>::bend() {
+    expose_elements();
+    return borrowed_iterator(_ptrs.data() + _ptrs.size(), _storage.get());
+}
+
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::pointer_iterator pyvec<T, Alloc>::pend() {
+    _dense = false;
+    expose_elements();
     return _ptrs.end();
 }
 
-template<typename T>
-typename pyvec<T>::reverse_iterator pyvec<T>::rend() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::reverse_iterator pyvec<T, Alloc>::rend() {
     return reverse_iterator(begin());
 }
 
-template<typename T>
-typename pyvec<T>::reverse_pointer_iterator pyvec<T>::rpend() {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::reverse_pointer_iterator pyvec<T, Alloc>::rpend() {
     return reverse_pointer_iterator(pbegin());
 }
 
@@ -902,37 +2506,92 @@ typename pyvec<T>::reverse_pointer_iterator pyvec<T>::rpend() {
  *  Vector-Like Capacity
  */
 
-template<typename T>
-bool pyvec<T>::empty() const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::empty() const {
     return _ptrs.empty();
 }
 
-template<typename T>
-size_t pyvec<T>::size() const {
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::size() const {
     return _ptrs.size();
 }
 
-template<typename T>
-void pyvec<T>::reserve(size_type new_cap) {
-    if (const auto delta = new_cap - capacity(); delta > 0) {
-        _ptrs.reserve(std::max(new_cap, _ptrs.size() + delta));
-        new_chunk(std::max(min_chunk_size, delta));
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::reserve(size_type new_cap) {
+    if (new_cap <= _ptrs.size()) { return; }
+    _ptrs.reserve(new_cap);
+    const auto needed = new_cap - _ptrs.size();
+    try_init();
+    if (const auto last = _storage->last; last != no_chunk) {
+        const auto& chunk = _storage->chunks[last];
+        if (chunk.capacity() - chunk.size() >= needed) { return; }
     }
+    new_chunk(needed);
+    use_chunk(_storage->chunks.size() - 1);
+}
+
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::capacity() const {
+    return _storage ? _storage->capacity : 0;
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::free_capacity() const -> size_type {
+    // try_init() detaches from a shared block before anything is appended
+    if (!_storage || (_cow && _storage.use_count() > 1)) { return 0; }
+    size_type slots = 0;
+    for (const auto& chunk : _storage->chunks) { slots += chunk.capacity() - chunk.size(); }
+    return std::min(slots, _ptrs.capacity() - _ptrs.size());
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::memory_usage() const -> size_type {
+    size_type bytes = _ptrs.allocated() * sizeof(pointer);
+    if (!_storage) { return bytes; }
+    const auto& store = *_storage;
+    bytes += sizeof(storage) + store.chunks.capacity() * sizeof(vec<T>);
+    bytes += store.capacity * sizeof(T);
+    bytes += store.buckets.capacity() * sizeof(vec<size_type>);
+    for (const auto& bucket : store.buckets) { bytes += bucket.capacity() * sizeof(size_type); }
+    return bytes;
+}
+
+template<typename T, typename Alloc>
+pyvec_stats pyvec<T, Alloc>::stats() const {
+    pyvec_stats ans;
+    ans.live        = _ptrs.size();
+    ans.table_bytes = _ptrs.allocated() * sizeof(pointer);
+    if (ans.live > 1) {
+        size_type adjacent = 0;
+        for (size_type i = 1; i < ans.live; ++i) { adjacent += _ptrs[i - 1] + 1 == _ptrs[i]; }
+        ans.locality = static_cast<double>(adjacent) / static_cast<double>(ans.live - 1);
+    }
+    if (!_storage) { return ans; }
+    const auto& store     = *_storage;
+    ans.chunks            = store.chunks.size();
+    ans.capacity          = store.capacity;
+    ans.storage_use_count = _storage.use_count();
+    for (const auto& chunk : store.chunks) { ans.used += chunk.size(); }
+    // live exceeds used when a copy-on-write child points into its parents' chunks
+    if (ans.used > ans.live) {
+        ans.fragmentation = 1 - static_cast<double>(ans.live) / static_cast<double>(ans.used);
+    }
+    ans.chunk_allocations = store.chunk_allocations;
+    ans.chunk_scans       = store.chunk_scans;
+    return ans;
 }
 
-template<typename T>
-size_t pyvec<T>::capacity() const {
-    return *_capacity;
-}
-
-template<typename T>
-void pyvec<T>::shrink_to_fit() {
-    try_init();
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::shrink_to_fit() {
     _ptrs.shrink_to_fit();
-    *_capacity = 0;
-    for (auto& chunk : *_resources) {
-        chunk.shrink_to_fit();
-        *_capacity += chunk.capacity();
+    if (!_storage) { return; }
+    // a partly filled chunk would have to reallocate and move its elements,
+    // which invalidates the pointer table and every shallow copy
+    for (auto& chunk : _storage->chunks) {
+        if (chunk.empty() && chunk.capacity() != 0) {
+            _storage->capacity -= chunk.capacity();
+            chunk = vec<T>(get_allocator());
+        }
     }
 }
 
@@ -940,35 +2599,39 @@ void pyvec<T>::shrink_to_fit() {
  *  Vector-Like Modifiers
  */
 
-template<typename T>
-void pyvec<T>::clear() {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::clear() {
     _ptrs.clear();
-    _chunk_pivot = 0;
-    _resources   = std::make_shared<vec<vec<T>>>();
-    _capacity    = std::make_shared<size_type>(0);
-    _last_chunk  = nullptr;
+    _storage = nullptr;
+    _dense   = true;
+    _sorted  = true;
+    index_reset();
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::insert(const const_iterator pos, const T& value) {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::insert(const const_iterator pos, const T& value) {
     const auto idx   = insert_empty(pos, 1);
     auto&      chunk = suitable_chunk(1);
     chunk.push_back(value);
     _ptrs[idx] = &chunk.back();
+    track_insert(idx);
+    index_add(chunk.back(), idx, idx + 1 != _ptrs.size());
     return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::insert(const const_iterator pos, T&& value) {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::insert(const const_iterator pos, T&& value) {
     const auto idx   = insert_empty(pos, 1);
     auto&      chunk = suitable_chunk(1);
     chunk.push_back(std::move(value));
     _ptrs[idx] = &chunk.back();
+    track_insert(idx);
+    index_add(chunk.back(), idx, idx + 1 != _ptrs.size());
     return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::insert(
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::insert(
     const_iterator pos, const size_type count, const T& value
 ) {
     if(count == 0) { return iterator(const_cast<pointer*>(pos._ptr)); }
@@ -979,141 +2642,195 @@ typename pyvec<T>::iterator pyvec<T>::insert(
         chunk.push_back(value);
         _ptrs[i] = &chunk.back();
     }
+    track_insert(idx);
+    index_reset();
     return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::insert(
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::insert(
     const const_iterator pos, std::initializer_list<T> il
 ) {
     return insert(pos, il.begin(), il.end());
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<class InputIt>
-typename pyvec<T>::iterator pyvec<T>::insert(
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::insert(
     const const_iterator pos, is_input_iterator_t<InputIt> first, InputIt last
 ) {
-    const auto count = std::distance(first, last);
-    if (count == 0) { return iterator(const_cast<pointer*>(pos._ptr)); }
-    auto       idx   = insert_empty(pos, count);
-    auto&      chunk = suitable_chunk(count);
-    size_t     pivot = idx;
-    for (auto it = first; it != last; ++it) {
-        chunk.push_back(*it);
-        _ptrs[pivot++] = &chunk.back();
+    if constexpr (!detail::is_forward_iterator_v<InputIt>) {
+        // a single pass range has to be buffered before its length is known
+        vec<T> buffer(first, last, get_allocator());
+        return insert(pos, std::make_move_iterator(buffer.begin()), std::make_move_iterator(buffer.end()));
+    } else {
+        const auto count = static_cast<size_type>(std::distance(first, last));
+        if (count == 0) { return iterator(const_cast<pointer*>(pos._ptr)); }
+        const difference_type idx = std::distance(cbegin(), pos);
+        if (idx < 0 || static_cast<size_type>(idx) > _ptrs.size()) {
+            throw std::out_of_range("pyvec::insert");
+        }
+        // copy before the gap is opened, the range may alias this pyvec's table
+        auto&      chunk = suitable_chunk(count);
+        const auto base  = chunk.size();
+        chunk.insert(chunk.end(), first, last);
+        insert_empty(pos, count);
+        link(_ptrs.data() + idx, chunk.data() + base, count);
+        track_insert(idx);
+        index_reset();
+        return iterator(_ptrs.data() + idx);
     }
-    return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<class... Args>
-typename pyvec<T>::iterator pyvec<T>::emplace(const const_iterator pos, Args&&... args) {
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::emplace(const const_iterator pos, Args&&... args) {
     const auto idx   = insert_empty(pos, 1);
     auto&      chunk = suitable_chunk(1);
     chunk.emplace_back(std::forward<Args>(args)...);
     _ptrs[idx] = &chunk.back();
+    track_insert(idx);
+    index_add(chunk.back(), idx, idx + 1 != _ptrs.size());
     return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::erase(const_iterator pos) {
-    const auto idx = std::distance(cbegin(), pos);
-    if (idx >= _ptrs.size() | idx < 0) { throw std::out_of_range("pyvec::erase"); }
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::erase(const_iterator pos) {
+    const auto dist = std::distance(cbegin(), pos);
+    if (dist < 0 || static_cast<size_type>(dist) >= _ptrs.size()) {
+        throw std::out_of_range("pyvec::erase");
+    }
+    const auto idx = static_cast<size_type>(dist);
+    track_erase(idx, idx + 1);
+    index_drop(*_ptrs[idx], idx, idx + 1 != _ptrs.size());
     _ptrs.erase(_ptrs.begin() + idx);
+    try_compact();
     return iterator(_ptrs.data() + idx);
 }
 
-template<typename T>
-typename pyvec<T>::iterator pyvec<T>::erase(const_iterator first, const_iterator last) {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::iterator pyvec<T, Alloc>::erase(const_iterator first, const_iterator last) {
     const auto left  = std::distance(cbegin(), first);
     const auto right = std::distance(cbegin(), last);
     if (left >= _ptrs.size() || left < 0 || right > _ptrs.size() || right < 0) {
         throw std::out_of_range("pyvec::erase");
     }
+    track_erase(left, right);
+    index_reset();
     _ptrs.erase(_ptrs.begin() + left, _ptrs.begin() + right);
+    try_compact();
     return iterator(_ptrs.data() + left);
 }
 
-template<typename T>
-void pyvec<T>::push_back(const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::push_back(const T& value) {
     auto& chunk = suitable_chunk(1);
     chunk.push_back(value);
+    track_append(&chunk.back());
+    track_order(chunk.back());
     _ptrs.push_back(&chunk.back());
+    index_add(chunk.back(), _ptrs.size() - 1, false);
 }
 
-template<typename T>
-void pyvec<T>::push_back(T&& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::push_back(T&& value) {
     auto& chunk = suitable_chunk(1);
     chunk.push_back(std::move(value));
+    track_append(&chunk.back());
+    track_order(chunk.back());
     _ptrs.push_back(&chunk.back());
+    index_add(chunk.back(), _ptrs.size() - 1, false);
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<class... Args>
-typename pyvec<T>::reference pyvec<T>::emplace_back(Args&&... args) {
+typename pyvec<T, Alloc>::reference pyvec<T, Alloc>::emplace_back(Args&&... args) {
     auto& chunk = suitable_chunk(1);
     chunk.emplace_back(std::forward<Args>(args)...);
+    track_append(&chunk.back());
     _ptrs.push_back(&chunk.back());
+    index_add(chunk.back(), _ptrs.size() - 1, false);
+    expose_elements();   // the element may be written through the returned reference
     return chunk.back();
 }
 
-template<typename T>
-void pyvec<T>::pop_back() {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::pop_back() {
     if (_ptrs.empty()) { throw std::out_of_range("pyvec::pop_back"); }
+    index_drop(*_ptrs.back(), _ptrs.size() - 1, false);
     _ptrs.pop_back();
+    try_compact();
 }
 
-template<typename T>
-void pyvec<T>::resize(size_type count) {
-    if (count <= size()) { return _ptrs.resize(count); }
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::resize(size_type count) {
+    index_reset();
+    if (count <= size()) {
+        _ptrs.resize(count);
+        return try_compact();
+    }
     const auto delta = count - size();
     auto&      chunk = suitable_chunk(delta);
     auto       idx   = chunk.size();
     chunk.resize(idx + delta);
     _ptrs.reserve(count);
+    track_append(&chunk[idx]);
+    track_order(chunk[idx]);
     for (; idx < chunk.size(); ++idx) { _ptrs.push_back(&chunk[idx]); }
 }
 
-template<typename T>
-void pyvec<T>::resize(size_type count, const T& value) {
-    if (count <= size()) { return _ptrs.resize(count); }
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::resize(size_type count, const T& value) {
+    index_reset();
+    if (count <= size()) {
+        _ptrs.resize(count);
+        return try_compact();
+    }
     const auto delta = count - size();
     auto&      chunk = suitable_chunk(delta);
     auto       idx   = chunk.size();
     chunk.resize(idx + delta, value);
     _ptrs.reserve(count);
+    track_append(&chunk[idx]);
+    track_order(chunk[idx]);
     for (; idx < chunk.size(); ++idx) { _ptrs.push_back(&chunk[idx]); }
 }
 
-template<typename T>
-void pyvec<T>::swap(pyvec<T>& other) noexcept {
-    std::swap(_resources, other._resources);
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::swap(pyvec<T, Alloc>& other) noexcept {
+    std::swap(_storage, other._storage);
     std::swap(_ptrs, other._ptrs);
-    std::swap(_chunk_pivot, other._chunk_pivot);
-    std::swap(_capacity, other._capacity);
+    std::swap(_compact_ratio, other._compact_ratio);
+    std::swap(_growth, other._growth);
+    std::swap(_cow, other._cow);
+    std::swap(_assume_sorted, other._assume_sorted);
+    std::swap(_relayout_sort, other._relayout_sort);
+    std::swap(_dense, other._dense);
+    std::swap(_sorted, other._sorted);
+    std::swap(_index, other._index);
 }
 
 /*
  *  Comparison
  */
-template<typename T>
-bool pyvec<T>::operator==(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator==(const pyvec<T, Alloc>& other) const {
     // need to check if T is comparable
     if (size() != other.size()) { return false; }
-    for (auto it = cbegin(), it2 = other.cbegin(); it != cend(); ++it, ++it2) {
-        if (*it != *it2) { return false; }
-    }
-    return true;
+    const bool other_dense = other.is_dense();
+    return !visit_spans(0, size(), [&](std::span<T> span, const size_type offset) {
+        if (other_dense) { return !std::equal(span.begin(), span.end(), other._ptrs[offset]); }
+        return !std::equal(span.begin(), span.end(), other.cbegin() + offset);
+    });
 }
 
-template<typename T>
-bool pyvec<T>::operator!=(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator!=(const pyvec<T, Alloc>& other) const {
     return !(*this == other);
 }
 
-template<typename T>
-bool pyvec<T>::operator<(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator<(const pyvec<T, Alloc>& other) const {
     // need to check if T is comparable
     const auto min_size = std::min(size(), other.size());
     for (auto i = 0; i < min_size; ++i) {
@@ -1123,18 +2840,18 @@ bool pyvec<T>::operator<(const pyvec<T>& other) const {
     return size() < other.size();
 }
 
-template<typename T>
-bool pyvec<T>::operator<=(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator<=(const pyvec<T, Alloc>& other) const {
     return !(other < *this);
 }
 
-template<typename T>
-bool pyvec<T>::operator>(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator>(const pyvec<T, Alloc>& other) const {
     return other < *this;
 }
 
-template<typename T>
-bool pyvec<T>::operator>=(const pyvec<T>& other) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::operator>=(const pyvec<T, Alloc>& other) const {
     return !(*this < other);
 }
 
@@ -1142,58 +2859,165 @@ bool pyvec<T>::operator>=(const pyvec<T>& other) const {
  *  Python-List-Like Interface
  */
 
-template<typename T>
-void pyvec<T>::append(const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::append(const T& value) {
     push_back(value);
 }
 
-template<typename T>
-void pyvec<T>::append(const shared<T>& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::append(const shared<T>& value) {
     push_back(*value);
 }
 
-template<typename T>
-size_t pyvec<T>::count(const T& value) const {
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::count(const T& value) const {
+    if constexpr (detail::hashable_v<T>) {
+        if (_index) {
+            const auto entry = index_find(value, false);
+            return entry ? entry->count : 0;
+        }
+    }
     size_t cnt = 0;
-    for (auto& item : _ptrs) {
-        if (*item == value) ++cnt;
+    if constexpr (detail::less_comparable_v<T>) {
+        if (known_sorted()) {
+            auto less = [](const const_pointer a, const T& b) { return *a < b; };
+            auto it   = std::lower_bound(_ptrs.begin(), _ptrs.end(), value, less);
+            for (; it != _ptrs.end() && !(value < **it); ++it) { cnt += **it == value; }
+            return cnt;
+        }
+    }
+    if constexpr (std::is_arithmetic_v<T>) {
+        visit_runs(
+            0,
+            size(),
+            [&](std::span<T> span, size_type) {
+                cnt += detail::count_equal(span.data(), span.size(), value);
+                return false;
+            },
+            [&](std::span<const pointer> ptrs, size_type) {
+                cnt += detail::count_equal_gather(ptrs.data(), ptrs.size(), value);
+                return false;
+            }
+        );
+    } else {
+        visit_spans(0, size(), [&](std::span<T> span, size_type) {
+            cnt += std::count(span.begin(), span.end(), value);
+            return false;
+        });
     }
     return cnt;
 }
 
-template<typename T>
-size_t pyvec<T>::count(const shared<T>& value) const {
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::count(const shared<T>& value) const {
     return count(*value);
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename InputIt>
-void pyvec<T>::extend(is_input_iterator_t<InputIt> first, InputIt last) {
+void pyvec<T, Alloc>::extend(is_input_iterator_t<InputIt> first, InputIt last) {
     insert(cend(), first, last);
 }
 
-template<typename T>
-void pyvec<T>::extend(const pyvec<T>& other) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(const pyvec<T, Alloc>& other) {
     insert(cend(), other.cbegin(), other.cend());
 }
 
-template<typename T>
-pyvec<T> pyvec<T>::copy() {
-    pyvec<T> ans{};
-    ans._resources = _resources;   // shallow copy
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(std::initializer_list<T> il) {
+    insert(cend(), il.begin(), il.end());
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(pyvec<T, Alloc>&& other) {
+    if (&other == this) { return extend(static_cast<const pyvec&>(other)); }
+    if (other.empty()) { return; }
+    if (!other.exclusive()) {
+        // copies or handles still see the elements, they must not be moved from
+        extend(static_cast<const pyvec&>(other));
+    } else if (get_allocator() != other.get_allocator()) {
+        insert(cend(), std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+    } else if (!_storage) {
+        _storage = std::move(other._storage);
+        _ptrs    = std::move(other._ptrs);
+        _dense   = other._dense;
+        _sorted  = other._sorted;
+        index_reset();
+    } else {
+        // moving a chunk keeps its buffer, so other's pointers stay valid
+        try_init();
+        for (auto& chunk : other._storage->chunks) { add_chunk(std::move(chunk)); }
+        for (auto& parent : other._storage->parents) { _storage->parents.push_back(std::move(parent)); }
+        for (auto& block : other._storage->external) { _storage->external.push_back(std::move(block)); }
+        _dense  = _ptrs.empty() && other._dense;
+        _sorted = false;
+        index_reset();
+        const auto raw_size = _ptrs.size();
+        _ptrs.resize(raw_size + other._ptrs.size());
+        std::copy(other._ptrs.begin(), other._ptrs.end(), _ptrs.data() + raw_size);
+    }
+    other.clear();
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(const std::span<T> elements, shared<void> keepalive) {
+    if (elements.empty()) { return; }
+    try_init();
+    _storage->external.push_back(std::move(keepalive));
+    track_append(elements.data());
+    _sorted = false;
+    index_reset();
+    const auto raw_size = _ptrs.size();
+    _ptrs.resize(raw_size + elements.size());
+    link(_ptrs.data() + raw_size, elements.data(), elements.size());
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(std::unique_ptr<T[]> buffer, const size_type count) {
+    if (count == 0) { return; }
+    const auto   first = buffer.get();
+    shared<void> owner(std::shared_ptr<T[]>(std::move(buffer)));
+    extend(std::span<T>(first, count), std::move(owner));
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::extend(vec<T>&& other) {
+    if (other.empty()) { return; }
+    if (get_allocator() != other.get_allocator()) {
+        insert(cend(), std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+        return other.clear();
+    }
+    try_init();
+    auto& chunk = add_chunk(std::move(other));
+    track_append(chunk.data());
+    _sorted = false;
+    index_reset();
+    const auto raw_size = _ptrs.size();
+    _ptrs.resize(raw_size + chunk.size());
+    link(_ptrs.data() + raw_size, chunk.data(), chunk.size());
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::copy() {
+    pyvec<T, Alloc> ans(get_allocator());
+    ans._storage = _storage;   // shallow copy
+    ans._cow     = _cow;
     ans._ptrs.assign(_ptrs.begin(), _ptrs.end());
-    ans._chunk_pivot = _chunk_pivot;
-    ans._capacity    = _capacity;   // shallow copy
+    ans._dense  = _dense;
+    ans._sorted = _sorted;
+    // either side may now write elements the other one sees
+    _sorted = false;
     return ans;
 }
 
-template<typename T>
-pyvec<T> pyvec<T>::deepcopy() {
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::deepcopy() {
     return pyvec(*this);
 }
 
-template<typename T>
-typename pyvec<T>::size_type pyvec<T>::pypos(difference_type index) const {
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::size_type pyvec<T, Alloc>::pypos(difference_type index) const {
     difference_type ans = index;
     if (ans < 0) { ans += size(); }
     if (ans < 0 | ans >= size()) {
@@ -1202,91 +3026,294 @@ typename pyvec<T>::size_type pyvec<T>::pypos(difference_type index) const {
     return ans;
 }
 
-template<typename T>
-std::shared_ptr<T> pyvec<T>::share(size_type index) {
+template<typename T, typename Alloc>
+std::shared_ptr<T> pyvec<T, Alloc>::share(size_type index) {
     T* ptr = _ptrs[index];
-    return std::shared_ptr<T>(_resources, ptr);
+    return std::shared_ptr<T>(_storage, ptr);
 }
 
-template<typename T>
-void pyvec<T>::insert(const difference_type index, const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::insert(const difference_type index, const T& value) {
     const difference_type pos = index >= size() ? size() : pypos(index);
     insert(cbegin() + pos, value);
 }
 
-template<typename T>
-void pyvec<T>::insert(const difference_type index, const shared<T>& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::insert(const difference_type index, const shared<T>& value) {
     insert(index, *value);
 }
 
-template<typename T>
-std::shared_ptr<T> pyvec<T>::pop(const difference_type index) {
+template<typename T, typename Alloc>
+std::shared_ptr<T> pyvec<T, Alloc>::pop(const difference_type index) {
     const size_type pos = pypos(index);
     shared<T>       ans = share(pos);
+    track_erase(pos, pos + 1);
+    index_drop(*ans, pos, pos + 1 != _ptrs.size());
     _ptrs.erase(_ptrs.begin() + pos);
+    try_compact();
     return ans;
 }
 
-template<typename T>
-void pyvec<T>::remove(const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::appendleft(const T& value) {
+    insert(cbegin(), value);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::appendleft(const shared<T>& value) {
+    insert(cbegin(), *value);
+}
+
+template<typename T, typename Alloc>
+std::shared_ptr<T> pyvec<T, Alloc>::popleft() {
+    return pop(0);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::remove(const T& value) {
     // remove the first occurrence of value
-    for (auto it = begin(); it != end(); ++it) {
-        if (*it == value) {
-            _ptrs.erase(_ptrs.begin() + std::distance(begin(), it));
-            return;
-        }
-    }
-    throw std::invalid_argument("pyvec::remove: value not found");
+    const auto pos = find_value(value, 0, size());
+    if (pos == size()) { throw std::invalid_argument("pyvec::remove: value not found"); }
+    track_erase(pos, pos + 1);
+    index_drop(*_ptrs[pos], pos, pos + 1 != _ptrs.size());
+    _ptrs.erase(_ptrs.begin() + pos);
+    try_compact();
 }
 
-template<typename T>
-void pyvec<T>::remove(const shared<T>& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::remove(const shared<T>& value) {
     remove(*value);
 }
 
-template<typename T>
-void pyvec<T>::reverse() {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::reverse() {
     std::reverse(_ptrs.begin(), _ptrs.end());
+    _dense  = _ptrs.size() < 2;
+    _sorted = _ptrs.size() < 2;
+    index_reordered();
 }
 
-template<typename T>
-void pyvec<T>::sort(const bool reverse) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::sort(const bool reverse) {
+    if (!reverse && known_sorted()) { return; }
     sort([](const T& k) -> const T& { return k; }, reverse);
+    _sorted = reverse ? _ptrs.size() < 2 : ordered();
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename Key>
-void pyvec<T>::sort(Key key, const bool reverse) {
+void pyvec<T, Alloc>::sort(Key key, const bool reverse) {
+    using key_type = std::decay_t<std::invoke_result_t<Key&, T&>>;
+    if constexpr (detail::radix_sortable_v<key_type>) {
+        if (_ptrs.size() >= radix_threshold) { return radix_sort(key, reverse); }
+    }
     auto cmp = [&key](const pointer& a, const pointer& b) { return key(*a) < key(*b); };
     if (reverse) {
         gfx::timsort(_ptrs.rbegin(), _ptrs.rend(), cmp);
     } else {
         gfx::timsort(_ptrs.begin(), _ptrs.end(), cmp);
     }
+    finish_sort();
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename Key>
-void pyvec<T>::sort_shared(Key key, const bool reverse) {
+void pyvec<T, Alloc>::sort_shared(Key key, const bool reverse) {
     auto cmp = [&](const pointer& a, const pointer& b) {
-        return key(shared<T>(_resources, a)) < key(shared<T>(_resources, b));
+        return key(ref(a, _storage.get())) < key(ref(b, _storage.get()));
     };
     if (reverse) {
         gfx::timsort(_ptrs.rbegin(), _ptrs.rend(), cmp);
     } else {
         gfx::timsort(_ptrs.begin(), _ptrs.end(), cmp);
     }
+    finish_sort();
 }
 
+template<typename T, typename Alloc>
+template<typename Key>
+void pyvec<T, Alloc>::sort_cached(Key key, const bool reverse) {
+    using key_type = std::decay_t<std::invoke_result_t<Key&, T&>>;
+    if constexpr (detail::radix_sortable_v<key_type>) {
+        if (_ptrs.size() >= radix_threshold) { return radix_sort(key, reverse); }
+    }
+    std::vector<std::pair<key_type, pointer>> decorated;
+    decorated.reserve(_ptrs.size());
+    for (auto ptr : _ptrs) { decorated.emplace_back(key(*ptr), ptr); }
+    sort_decorated(decorated, reverse);
+}
 
-template<typename T>
-bool pyvec<T>::is_sorted(const bool reverse) const {
+template<typename T, typename Alloc>
+template<typename Key>
+void pyvec<T, Alloc>::sort_shared_cached(Key key, const bool reverse) {
+    using key_type = std::decay_t<std::invoke_result_t<Key&, const ref&>>;
+    std::vector<std::pair<key_type, pointer>> decorated;
+    decorated.reserve(_ptrs.size());
+    for (auto ptr : _ptrs) { decorated.emplace_back(key(ref(ptr, _storage.get())), ptr); }
+    sort_decorated(decorated, reverse);
+}
+
+template<typename T, typename Alloc>
+template<typename K>
+void pyvec<T, Alloc>::sort_decorated(std::vector<std::pair<K, pointer>>& decorated, const bool reverse) {
+    using item = std::pair<K, pointer>;
+    auto cmp   = [](const item& a, const item& b) { return a.first < b.first; };
+    if (reverse) {
+        gfx::timsort(decorated.rbegin(), decorated.rend(), cmp);
+    } else {
+        gfx::timsort(decorated.begin(), decorated.end(), cmp);
+    }
+    auto target = _ptrs.data();
+    for (auto& [_, ptr] : decorated) { *target++ = ptr; }
+    finish_sort();
+}
+
+template<typename T, typename Alloc>
+template<typename Key>
+void pyvec<T, Alloc>::radix_sort(Key& key, const bool reverse) {
+    using key_type   = std::decay_t<std::invoke_result_t<Key&, T&>>;
+    using radix_type = decltype(detail::radix_key(std::declval<key_type>()));
+    std::vector<std::pair<radix_type, pointer>> decorated;
+    decorated.reserve(_ptrs.size());
+    for (auto ptr : _ptrs) {
+        const auto k = detail::radix_key(static_cast<key_type>(key(*ptr)));
+        // inverting the key sorts descending while equal keys keep their order
+        decorated.emplace_back(reverse ? static_cast<radix_type>(~k) : k, ptr);
+    }
+    detail::radix_sort(decorated.data(), decorated.size());
+    auto target = _ptrs.data();
+    for (auto& [_, ptr] : decorated) { *target++ = ptr; }
+    finish_sort();
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::sort_parallel(const bool reverse, const size_type n_threads) {
+    if (!reverse && known_sorted()) { return; }
+    sort_parallel([](const T& k) -> const T& { return k; }, reverse, n_threads);
+    _sorted = reverse ? _ptrs.size() < 2 : ordered();
+}
+
+template<typename T, typename Alloc>
+template<typename Key>
+void pyvec<T, Alloc>::sort_parallel(Key key, const bool reverse, const size_type n_threads) {
+    using key_type    = std::decay_t<std::invoke_result_t<Key&, T&>>;
+    const auto n      = _ptrs.size();
+    const auto blocks = std::min(detail::resolve_threads(n_threads), n / parallel_min_block);
+    if (blocks <= 1) { return sort(key, reverse); }
+    const auto bounds = detail::block_bounds(n, blocks);
+
+    if constexpr (detail::radix_sortable_v<key_type>) {
+        using radix_type = decltype(detail::radix_key(std::declval<key_type>()));
+        using item       = std::pair<radix_type, pointer>;
+        std::vector<item> decorated(n);
+        detail::parallel_for(blocks, [&](const size_t i) {
+            for (auto j = bounds[i]; j < bounds[i + 1]; ++j) {
+                const auto k = detail::radix_key(static_cast<key_type>(key(*_ptrs[j])));
+                decorated[j] = {reverse ? static_cast<radix_type>(~k) : k, _ptrs[j]};
+            }
+        });
+        detail::parallel_merge_sort(
+            decorated.data(),
+            bounds,
+            [](item* first, item* last) { detail::radix_sort(first, last - first); },
+            [](const item& a, const item& b) { return a.first < b.first; }
+        );
+        detail::parallel_for(blocks, [&](const size_t i) {
+            for (auto j = bounds[i]; j < bounds[i + 1]; ++j) { _ptrs[j] = decorated[j].second; }
+        });
+    } else {
+        using item = std::pair<key_type, pointer>;
+        std::vector<item> decorated;
+        if constexpr (std::is_default_constructible_v<key_type>) {
+            decorated.resize(n);
+            detail::parallel_for(blocks, [&](const size_t i) {
+                for (auto j = bounds[i]; j < bounds[i + 1]; ++j) {
+                    decorated[j] = item(key(*_ptrs[j]), _ptrs[j]);
+                }
+            });
+        } else {
+            decorated.reserve(n);
+            for (auto ptr : _ptrs) { decorated.emplace_back(key(*ptr), ptr); }
+        }
+        auto cmp      = [](const item& a, const item& b) { return a.first < b.first; };
+        auto sort_run = [&cmp](auto first, auto last) { gfx::timsort(first, last, cmp); };
+        // sorting the reversed range keeps equal keys in their original order
+        if (reverse) {
+            detail::parallel_merge_sort(decorated.rbegin(), bounds, sort_run, cmp);
+        } else {
+            detail::parallel_merge_sort(decorated.begin(), bounds, sort_run, cmp);
+        }
+        detail::parallel_for(blocks, [&](const size_t i) {
+            for (auto j = bounds[i]; j < bounds[i + 1]; ++j) { _ptrs[j] = decorated[j].second; }
+        });
+    }
+    finish_sort();
+}
+
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::is_sorted(const bool reverse) const {
+    if (!reverse && known_sorted()) { return true; }
+    if (!reverse && ordered()) {
+        _sorted = true;
+        return true;
+    }
     return is_sorted([](const T& k) -> const T& { return k; }, reverse);
 }
 
-template<typename T>
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::bisect_left(const T& value) const -> size_type {
+    const auto it = std::lower_bound(
+        _ptrs.begin(), _ptrs.end(), value, [](const const_pointer a, const T& b) { return *a < b; }
+    );
+    return it - _ptrs.begin();
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::bisect_right(const T& value) const -> size_type {
+    const auto it = std::upper_bound(
+        _ptrs.begin(), _ptrs.end(), value, [](const T& a, const const_pointer b) { return a < *b; }
+    );
+    return it - _ptrs.begin();
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::insort(const T& value) {
+    const bool sorted = _sorted;
+    const auto pos    = bisect_right(value);
+    insert(cbegin() + pos, value);
+    _sorted = sorted && (pos == 0 || detail::in_order(*_ptrs[pos - 1], value))
+           && (pos + 1 == _ptrs.size() || detail::in_order(value, *_ptrs[pos + 1]));
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::merge(const pyvec<T, Alloc>& other) {
+    const bool sorted = is_sorted() && other.is_sorted();
+    const auto mid    = _ptrs.size();
+    extend(other);
+    merge_tail(mid, sorted);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::merge(pyvec<T, Alloc>&& other) {
+    const bool sorted = is_sorted() && other.is_sorted();
+    const auto mid    = _ptrs.size();
+    extend(std::move(other));
+    merge_tail(mid, sorted);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::merge_tail(const size_type mid, const bool sorted) {
+    if (!sorted) { return sort(); }
+    auto cmp = [](const pointer& a, const pointer& b) { return *a < *b; };
+    gfx::timmerge(_ptrs.begin(), _ptrs.begin() + mid, _ptrs.end(), cmp);
+    finish_sort();
+    _sorted = ordered();
+}
+
+template<typename T, typename Alloc>
 template<typename Key>
-bool pyvec<T>::is_sorted(Key key, const bool reverse) const {
+bool pyvec<T, Alloc>::is_sorted(Key key, const bool reverse) const {
     auto cmp = [&key](const pointer& a, const pointer& b) { return key(*a) < key(*b); };
     if (reverse) {
         return std::is_sorted(_ptrs.rbegin(), _ptrs.rend(), cmp);
@@ -1295,11 +3322,11 @@ bool pyvec<T>::is_sorted(Key key, const bool reverse) const {
     }
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename Key>
-bool pyvec<T>::is_sorted_shared(Key key, const bool reverse) const {
+bool pyvec<T, Alloc>::is_sorted_shared(Key key, const bool reverse) const {
     auto cmp = [&](const pointer& a, const pointer& b) {
-        return key(shared<T>(_resources, a)) < key(shared<T>(_resources, b));
+        return key(ref(a, _storage.get())) < key(ref(b, _storage.get()));
     };
     if (reverse) {
         return std::is_sorted(_ptrs.rbegin(), _ptrs.rend(), cmp);
@@ -1308,26 +3335,140 @@ bool pyvec<T>::is_sorted_shared(Key key, const bool reverse) const {
     }
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename Func>
-void pyvec<T>::filter(Func func) {
+void pyvec<T, Alloc>::filter(Func func) {
     auto it = std::remove_if(_ptrs.begin(), _ptrs.end(), [&func](const pointer& ptr) {
         return !func(*ptr);
     });
+    if (it != _ptrs.end()) {
+        _dense = false;
+        index_reset();
+    }
     _ptrs.erase(it, _ptrs.end());
+    try_compact();
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename Func>
-void pyvec<T>::filter_shared(Func func) {
+void pyvec<T, Alloc>::filter_shared(Func func) {
     auto it = std::remove_if(_ptrs.begin(), _ptrs.end(), [&func, this](const pointer& ptr) {
-        return !func(shared<T>(_resources, ptr));
+        return !func(ref(ptr, _storage.get()));
     });
+    if (it != _ptrs.end()) {
+        _dense = false;
+        index_reset();
+    }
     _ptrs.erase(it, _ptrs.end());
+    try_compact();
 }
 
-template<typename T>
-size_t pyvec<T>::index(
+template<typename T, typename Alloc>
+template<typename Func>
+void pyvec<T, Alloc>::filter_parallel(Func func, const size_type n_threads) {
+    filter_blocks([&func](const pointer ptr) -> bool { return func(*ptr); }, n_threads);
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+void pyvec<T, Alloc>::filter_shared_parallel(Func func, const size_type n_threads) {
+    filter_blocks(
+        [&func, this](const pointer ptr) -> bool { return func(ref(ptr, _storage.get())); },
+        n_threads
+    );
+}
+
+template<typename T, typename Alloc>
+template<typename Keep>
+void pyvec<T, Alloc>::filter_blocks(Keep keep, const size_type n_threads) {
+    const auto n      = _ptrs.size();
+    const auto blocks = std::min(detail::resolve_threads(n_threads), n / parallel_min_block);
+    if (blocks <= 1) {
+        auto it = std::remove_if(_ptrs.begin(), _ptrs.end(), [&keep](const pointer ptr) {
+            return !keep(ptr);
+        });
+        if (it != _ptrs.end()) {
+            _dense = false;
+            index_reset();
+        }
+        _ptrs.erase(it, _ptrs.end());
+        return try_compact();
+    }
+    const auto bounds = detail::block_bounds(n, blocks);
+
+    // the table is only touched once every predicate has returned
+    std::vector<uint8_t> kept(n);
+    std::vector<size_t>  offsets(blocks + 1, 0);
+    detail::parallel_for(blocks, [&](const size_t i) {
+        size_t count = 0;
+        for (auto j = bounds[i]; j < bounds[i + 1]; ++j) { count += kept[j] = keep(_ptrs[j]); }
+        offsets[i + 1] = count;
+    });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    if (offsets[blocks] == n) { return; }
+
+    table result(_ptrs.get_allocator());
+    result.resize(offsets[blocks]);
+    detail::parallel_for(blocks, [&](const size_t i) {
+        auto target = result.data() + offsets[i];
+        for (auto j = bounds[i]; j < bounds[i + 1]; ++j) {
+            if (kept[j]) { *target++ = _ptrs[j]; }
+        }
+    });
+    _ptrs  = std::move(result);
+    _dense = false;
+    index_reset();
+    try_compact();
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+auto pyvec<T, Alloc>::map(Func func) const {
+    using U = std::decay_t<std::invoke_result_t<Func&, const T&>>;
+    const auto                  alloc = alloc_of<U>(get_allocator());
+    std::vector<U, alloc_of<U>> values(alloc);
+    values.reserve(_ptrs.size());
+    for (const auto ptr : _ptrs) { values.push_back(func(std::as_const(*ptr))); }
+    return pyvec<U, alloc_of<U>>(std::move(values));
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+auto pyvec<T, Alloc>::map_parallel(Func func, const size_type n_threads) const {
+    using U           = std::decay_t<std::invoke_result_t<Func&, const T&>>;
+    using values_type = std::vector<U, alloc_of<U>>;
+    const auto n      = _ptrs.size();
+    const auto blocks = std::min(detail::resolve_threads(n_threads), n / parallel_min_block);
+    if (blocks <= 1) { return map(func); }
+    const auto bounds = detail::block_bounds(n, blocks);
+    const auto alloc  = alloc_of<U>(get_allocator());
+
+    if constexpr (std::is_default_constructible_v<U> && std::is_move_assignable_v<U>) {
+        // one dense chunk, filled in place by the blocks
+        values_type values(n, alloc);
+        detail::parallel_for(blocks, [&](const size_t i) {
+            for (auto j = bounds[i]; j < bounds[i + 1]; ++j) {
+                values[j] = func(std::as_const(*_ptrs[j]));
+            }
+        });
+        return pyvec<U, alloc_of<U>>(std::move(values));
+    } else {
+        // every block builds a chunk of its own, which the result adopts
+        std::vector<values_type> parts(blocks, values_type(alloc));
+        detail::parallel_for(blocks, [&](const size_t i) {
+            parts[i].reserve(bounds[i + 1] - bounds[i]);
+            for (auto j = bounds[i]; j < bounds[i + 1]; ++j) {
+                parts[i].push_back(func(std::as_const(*_ptrs[j])));
+            }
+        });
+        pyvec<U, alloc_of<U>> result(alloc);
+        for (auto& part : parts) { result.extend(std::move(part)); }
+        return result;
+    }
+}
+
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::index(
     const T&                             value,
     const std::optional<difference_type> start,
     const std::optional<difference_type> stop
@@ -1336,14 +3477,14 @@ size_t pyvec<T>::index(
     difference_type right = stop.value_or(size());
 
     right = right >= size() ? size() : pypos(right);
-    for (auto i = left; i < right; ++i) {
-        if (*_ptrs[i] == value) { return i; }
+    if (const auto ans = find_value(value, left, right); ans != static_cast<size_type>(right)) {
+        return ans;
     }
     throw std::invalid_argument("pyvec::index: value not found");
 }
 
-template<typename T>
-size_t pyvec<T>::index(
+template<typename T, typename Alloc>
+size_t pyvec<T, Alloc>::index(
     const shared<T>&                     value,
     const std::optional<difference_type> start,
     const std::optional<difference_type> stop
@@ -1354,75 +3495,52 @@ size_t pyvec<T>::index(
 /*
  *  Python Magic Method
  */
-template<typename T>
-typename pyvec<T>::slice_native pyvec<T>::build_slice(const slice& t_slice) const {
-    difference_type start, stop, num_steps;
-    difference_type step   = t_slice.step.value_or(1);
-    auto            v_size = static_cast<difference_type>(size());
-    constexpr auto  zero   = static_cast<difference_type>(0);
-    if (step == 0) { throw std::invalid_argument("slice::step == 0"); }
-    if (step > 0) {
-        start = t_slice.start.value_or(0);
-        if (start < 0) {
-            start = std::max(zero, start + v_size);
-        } else {
-            start = std::min(start, v_size);
-        }
-
-        stop = t_slice.stop.value_or(v_size);
-        if (stop < 0) {
-            stop = std::max(zero, stop + v_size);
-        } else {
-            stop = std::min(stop, v_size);
-        }
-
-        num_steps = std::max(zero, (stop - start - 1) / step + 1);
-    } else {
-        start = t_slice.start.value_or(v_size - 1);
-        if (start < 0) {
-            start = std::max(static_cast<difference_type>(-1), start + v_size);
-        } else {
-            start = std::min(start, v_size - 1);
-        }
-
-        if (t_slice.stop.has_value()) {
-            stop = t_slice.stop.value();
-            if (stop < 0) {
-                stop = std::max(static_cast<difference_type>(-1), stop + v_size);
-            } else {
-                stop = std::min(stop, v_size);
-            }
-        } else {
-            stop = -1;
-        }
-
-        num_steps = std::max(zero, (start - stop - 1) / -step + 1);
-    }
-    return {static_cast<size_type>(start), static_cast<size_type>(num_steps), step};
+template<typename T, typename Alloc>
+typename pyvec<T, Alloc>::slice_native pyvec<T, Alloc>::build_slice(const slice& t_slice) const {
+    return detail::build_slice(t_slice, size());
 }
 
-template<typename T>
-void pyvec<T>::setitem(const difference_type index, const T& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::setitem(const difference_type index, const T& value) {
     const auto pos   = pypos(index);
     auto&      chunk = suitable_chunk(1);
     chunk.push_back(value);
+    index_drop(*_ptrs[pos], pos, false);
+    index_add(chunk.back(), pos, false);
     _ptrs[pos] = &chunk.back();
+    _dense     = false;
+    _sorted    = false;
+    try_compact();
 }
 
-template<typename T>
-void pyvec<T>::setitem(const difference_type index, const shared<T>& value) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::setitem(const difference_type index, const shared<T>& value) {
     setitem(index, *value);
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template<typename InputIt>
-void pyvec<T>::setitem(const slice& t_slice, is_input_iterator_t<InputIt> first, InputIt last) {
-    auto      s          = build_slice(t_slice);
-    size_type other_size = std::distance(first, last);
-    if (other_size == 0) { this->delitem(t_slice); }
+void pyvec<T, Alloc>::setitem(const slice& t_slice, is_input_iterator_t<InputIt> first, InputIt last) {
+    if constexpr (!detail::is_forward_iterator_v<InputIt>) {
+        vec<T> buffer(first, last, get_allocator());
+        return setitem(t_slice, std::make_move_iterator(buffer.begin()), std::make_move_iterator(buffer.end()));
+    }
+    const auto s          = build_slice(t_slice);
+    const auto other_size = static_cast<size_type>(std::distance(first, last));
+    if (other_size == 0) {
+        if (s.step == 1 || s.num_steps == 0) { return delitem(t_slice); }
+        throw std::invalid_argument("pyvec::setitem: incompatible slice and sequence");
+    }
+    _dense  = false;
+    _sorted = false;
+    index_reset();
     if (s.step == 1) {
         difference_type delta =
             static_cast<difference_type>(other_size) - static_cast<difference_type>(s.num_steps);
+        // copy before the table changes, the range may alias it
+        auto&      chunk = suitable_chunk(other_size);
+        const auto base  = chunk.size();
+        chunk.insert(chunk.end(), first, last);
         if (delta > 0) {
             insert_empty(cbegin() + s.start + s.num_steps, delta);
         } else if (delta < 0) {
@@ -1430,50 +3548,58 @@ void pyvec<T>::setitem(const slice& t_slice, is_input_iterator_t<InputIt> first,
                 _ptrs.begin() + s.start + s.num_steps + delta, _ptrs.begin() + s.start + s.num_steps
             );
         }
-
-        auto&  chunk = suitable_chunk(other_size);
-        size_t pivot = s.start;
-        for (auto it = first; it != last; ++it) {
-            chunk.push_back(*it);
-            _ptrs[pivot++] = &chunk.back();
-        }
+        link(_ptrs.data() + s.start, chunk.data() + base, other_size);
     } else if (s.num_steps == other_size) {
-        auto&  chunk = suitable_chunk(s.num_steps);
-        size_t pivot = s.start;
-        for (auto it = first; it != last; ++it) {
-            chunk.push_back(*it);
-            _ptrs[pivot] = &chunk.back();
-            pivot += s.step;
+        auto&      chunk = suitable_chunk(other_size);
+        const auto base  = chunk.size();
+        chunk.insert(chunk.end(), first, last);
+        auto target = _ptrs.data() + s.start;
+        for (auto ptr = chunk.data() + base; ptr != chunk.data() + chunk.size(); ++ptr) {
+            *target = ptr;
+            target += s.step;
         }
     } else {
         throw std::invalid_argument("pyvec::setitem: incompatible slice and sequence");
     }
+    try_compact();
 }
 
-template<typename T>
-void pyvec<T>::setitem(const slice& t_slice, const pyvec<T>& other) {
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::setitem(const slice& t_slice, const pyvec<T, Alloc>& other) {
     setitem(t_slice, other.cbegin(), other.cend());
 }
 
-template<typename T>
-std::shared_ptr<T> pyvec<T>::getitem(const difference_type index) {
+template<typename T, typename Alloc>
+std::shared_ptr<T> pyvec<T, Alloc>::getitem(const difference_type index) {
+    expose_elements();
     return share(pypos(index));
 }
 
-template<typename T>
-pyvec<T> pyvec<T>::getitem(const slice& t_slice) {
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::borrow(const difference_type index) -> ref {
+    expose_elements();
+    return ref(_ptrs[pypos(index)], _storage.get());
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::getitem(const slice& t_slice) {
     auto s = build_slice(t_slice);
-    if (s.num_steps == 0) { return pyvec<T>{}; }
+    if (s.num_steps == 0) { return pyvec<T, Alloc>(get_allocator()); }
 
-    pyvec<T> ans;
-    ans._capacity    = _capacity;
-    ans._resources   = _resources;
-    ans._chunk_pivot = _chunk_pivot;
+    pyvec<T, Alloc> ans(get_allocator());
+    ans._storage = _storage;
+    ans._cow     = _cow;
+    // a subsequence in forward order keeps the order
+    ans._sorted = s.step > 0 ? static_cast<bool>(_sorted) : s.num_steps < 2;
+    // either side may now write elements the other one sees
+    _sorted = false;
 
     if (s.step == 1) {
+        ans._dense = _dense;
         // std::copy is faster than loop
         ans._ptrs.assign(_ptrs.begin() + s.start, _ptrs.begin() + s.start + s.num_steps);
     } else {
+        ans._dense = s.num_steps < 2;
         ans._ptrs.reserve(s.num_steps);
         size_t pivot = s.start;
         for (size_t i = 0; i < s.num_steps; ++i) {
@@ -1484,39 +3610,75 @@ pyvec<T> pyvec<T>::getitem(const slice& t_slice) {
     return ans;
 }
 
-template<typename T>
-void pyvec<T>::delitem(const difference_type index) {
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::view() -> view_type {
+    expose_elements();
+    return view_type(this, _ptrs.data(), _ptrs.size(), 1);
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::view(const slice& t_slice) -> view_type {
+    expose_elements();
+    const auto s = build_slice(t_slice);
+    return view_type(this, _ptrs.data() + (s.num_steps != 0 ? s.start : 0), s.num_steps, s.step);
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::view() const -> const_view_type {
+    return const_view_type(this, _ptrs.data(), _ptrs.size(), 1);
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::view(const slice& t_slice) const -> const_view_type {
+    const auto s = build_slice(t_slice);
+    return const_view_type(this, _ptrs.data() + (s.num_steps != 0 ? s.start : 0), s.num_steps, s.step);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::delitem(const difference_type index) {
     const auto pos = pypos(index);
+    track_erase(pos, pos + 1);
+    index_drop(*_ptrs[pos], pos, pos + 1 != _ptrs.size());
     _ptrs.erase(_ptrs.begin() + pos);
+    try_compact();
 }
 
-template<typename T>
-void pyvec<T>::delitem(const slice& t_slice) {
-    auto s = build_slice(t_slice);
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::delitem(const slice& t_slice) {
+    const auto s = build_slice(t_slice);
     if (s.num_steps == 0) { return; }
-    auto new_ptrs = vec<pointer>{};
-    new_ptrs.reserve(size() - s.num_steps);
-    for (difference_type i = 0; i < size(); ++i) {
-        const auto delta = i - static_cast<difference_type>(s.start);
-        if ((delta % s.step == 0) && (delta / s.step < s.num_steps)) {
-            continue;
-        } else {
-            new_ptrs.push_back(_ptrs[i]);
-        }
+    index_reset();
+    // walk the deleted positions upwards, whatever the direction of the slice
+    const auto step  = static_cast<size_type>(s.step > 0 ? s.step : -s.step);
+    const auto first = s.step > 0 ? s.start : s.start - (s.num_steps - 1) * step;
+    const auto last  = first + (s.num_steps - 1) * step;
+    if (step == 1 || s.num_steps == 1) {
+        track_erase(first, last + 1);
+        _ptrs.erase(_ptrs.begin() + first, _ptrs.begin() + last + 1);
+        return try_compact();
     }
-
-    _ptrs = std::move(new_ptrs);
+    // close the gaps in place, only the part behind the first deleted entry moves
+    const auto data   = _ptrs.data();
+    auto       target = data + first;
+    for (auto gap = first; gap < last; gap += step) {
+        target = std::copy(data + gap + 1, data + gap + step, target);
+    }
+    std::copy(data + last + 1, data + _ptrs.size(), target);
+    _ptrs.resize(_ptrs.size() - s.num_steps);
+    _dense = false;
+    try_compact();
 }
 
-template<typename T>
-bool pyvec<T>::contains(const T& value) const {
-    auto check = [&value](const pointer& ptr) { return *ptr == value; };
-    if (std::any_of(_ptrs.begin(), _ptrs.end(), check)) { return true; }
-    return false;
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::contains(const T& value) const {
+    if constexpr (detail::hashable_v<T>) {
+        if (_index) { return index_find(value, false).has_value(); }
+    }
+    return find_value(value, 0, size()) != size();
 }
 
-template<typename T>
-bool pyvec<T>::contains(const shared<T>& value) const {
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::contains(const shared<T>& value) const {
     return contains(*value);
 }
 
@@ -1524,9 +3686,274 @@ bool pyvec<T>::contains(const shared<T>& value) const {
  *  Pyvec Specific Functions
  */
 
-template<typename T>
-std::vector<T> pyvec<T>::collect() const {
-    return std::vector<T>{cbegin(), cend()};
+template<typename T, typename Alloc>
+std::span<T> pyvec<T, Alloc>::as_span() {
+    if (empty()) { return {}; }
+    if (!is_dense()) { throw std::logic_error("pyvec::as_span: elements are not contiguous"); }
+    expose_elements();
+    return std::span<T>(_ptrs.front(), size());
+}
+
+template<typename T, typename Alloc>
+std::span<const T> pyvec<T, Alloc>::as_span() const {
+    if (empty()) { return {}; }
+    if (!is_dense()) { throw std::logic_error("pyvec::as_span: elements are not contiguous"); }
+    return std::span<const T>(_ptrs.front(), size());
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::collect() const -> vec<T> {
+    vec<T> ans(get_allocator());
+    ans.reserve(size());
+    visit_spans(0, size(), [&ans](std::span<T> span, size_type) {
+        ans.insert(ans.end(), span.begin(), span.end());
+        return false;
+    });
+    return ans;
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+void pyvec<T, Alloc>::for_each_span(Func func) {
+    expose_elements();
+    visit_spans(0, size(), [&func](std::span<T> span, size_type) {
+        func(span);
+        return false;
+    });
+}
+
+template<typename T, typename Alloc>
+template<typename Func>
+void pyvec<T, Alloc>::for_each_span(Func func) const {
+    visit_spans(0, size(), [&func](std::span<T> span, size_type) {
+        func(std::span<const T>(span));
+        return false;
+    });
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::compact() {
+    // copies and shared<T> handles alias _storage, their chunks must stay alive
+    if (!exclusive()) { return false; }
+    rebuild();
+    return true;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_compact_threshold(const double ratio) {
+    if (ratio < 0 || ratio > 1) {
+        throw std::invalid_argument("pyvec::set_compact_threshold: ratio must be in [0, 1]");
+    }
+    _compact_ratio = ratio;
+    try_compact();
+}
+
+template<typename T, typename Alloc>
+double pyvec<T, Alloc>::compact_threshold() const {
+    return _compact_ratio;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::relayout() {
+    if (is_dense()) { return; }
+    rebuild();
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::is_dense() const {
+    if (_dense || _ptrs.empty()) { return true; }
+    const auto first = _ptrs.front();
+    for (size_type i = 1; i < _ptrs.size(); ++i) {
+        if (_ptrs[i] != first + i) { return false; }
+    }
+    return _dense = true;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_relayout_on_sort(const bool enable) {
+    _relayout_sort = enable;
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::relayout_on_sort() const {
+    return _relayout_sort;
+}
+
+template<typename T, typename Alloc>
+auto pyvec<T, Alloc>::appender(const size_type batch_size) -> concurrent_appender {
+    return concurrent_appender(*this, batch_size);
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_copy_on_write(const bool enable) {
+    _cow = enable;
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::copy_on_write() const {
+    return _cow;
 }
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_assume_sorted(const bool enable) {
+    _assume_sorted = enable;
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::assume_sorted() const {
+    return _assume_sorted;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_hash_index(const bool enable) {
+    static_assert(detail::hashable_v<T>, "pyvec::set_hash_index requires std::hash<T>");
+    // a fresh index is filled by the next lookup
+    _index = enable ? std::allocate_shared<index_type>(get_allocator(), get_allocator()) : nullptr;
+}
+
+template<typename T, typename Alloc>
+bool pyvec<T, Alloc>::hash_index() const {
+    return _index != nullptr;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::set_growth_policy(const growth_policy& policy) {
+    if (!(policy.factor > 1)) {
+        throw std::invalid_argument("pyvec::set_growth_policy: factor must be greater than 1");
+    }
+    _growth = policy;
+}
+
+template<typename T, typename Alloc>
+growth_policy pyvec<T, Alloc>::get_growth_policy() const {
+    return _growth;
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::save(std::ostream& os) const {
+    static_assert(std::is_trivially_copyable_v<T>, "pyvec::save requires a trivially copyable T");
+    detail::file_header header;
+    header.element_size = sizeof(T);
+    header.count        = size();
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    visit_spans(0, size(), [&os](std::span<T> span, size_type) {
+        os.write(reinterpret_cast<const char*>(span.data()), span.size_bytes());
+        return !os;
+    });
+    if (!os) { throw std::runtime_error("pyvec::save: write failed"); }
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::save(const std::string& path) const {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os) { throw std::runtime_error("pyvec::save: cannot open " + path); }
+    save(os);
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::load(std::istream& is, const Alloc& alloc) {
+    static_assert(std::is_trivially_copyable_v<T>, "pyvec::load requires a trivially copyable T");
+    detail::file_header header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!is || header.magic != detail::file_header::expected_magic) {
+        throw std::runtime_error("pyvec::load: not a pyvec file");
+    }
+    if (header.element_size != sizeof(T)) {
+        throw std::runtime_error("pyvec::load: element size mismatch");
+    }
+    // the count is only trusted as far as the stream backs it: a seekable stream is measured
+    // first, and the payload is read in bounded blocks in any case
+    const auto start    = is.tellg();
+    bool       measured = false;
+    if (start != std::streampos(-1)) {
+        if (is.seekg(0, std::ios::end)) {
+            const auto available = static_cast<uint64_t>(is.tellg() - start);
+            if (header.count > available / sizeof(T)) {
+                throw std::runtime_error("pyvec::load: truncated payload");
+            }
+            measured = true;
+        }
+        is.clear();
+        if (!is.seekg(start)) { throw std::runtime_error("pyvec::load: cannot seek"); }
+    }
+    pyvec<T, Alloc> ans(alloc);
+    vec<T>          chunk(ans.get_allocator());
+    if (measured) { chunk.reserve(header.count); }
+    constexpr size_type block = std::max<size_type>(1, (size_type{1} << 20) / sizeof(T));
+    while (chunk.size() < header.count) {
+        const auto done = chunk.size();
+        const auto n    = std::min<uint64_t>(block, header.count - done);
+        chunk.resize(done + n);
+        is.read(reinterpret_cast<char*>(chunk.data() + done), static_cast<std::streamsize>(n * sizeof(T)));
+        if (!is) { throw std::runtime_error("pyvec::load: truncated payload"); }
+    }
+    ans.extend(std::move(chunk));
+    return ans;
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::load(const std::string& path, const Alloc& alloc) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) { throw std::runtime_error("pyvec::load: cannot open " + path); }
+    return load(is, alloc);
+}
+
+template<typename T, typename Alloc>
+pyvec<T, Alloc> pyvec<T, Alloc>::map_file(const std::string& path, const Alloc& alloc) {
+    static_assert(std::is_trivially_copyable_v<T>, "pyvec::map_file requires a trivially copyable T");
+    static_assert(alignof(T) <= sizeof(detail::file_header), "pyvec::map_file: over-aligned T");
+#if defined(PYVEC_HAS_MMAP)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { throw std::runtime_error("pyvec::map_file: cannot open " + path); }
+    struct stat info {};
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(detail::file_header)) {
+        ::close(fd);
+        throw std::runtime_error("pyvec::map_file: not a pyvec file");
+    }
+    const auto length = static_cast<size_t>(info.st_size);
+    void*      addr   = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) { throw std::runtime_error("pyvec::map_file: mmap failed"); }
+    shared<void> mapping(addr, [length](void* ptr) { ::munmap(ptr, length); });
+
+    const auto& header = *static_cast<const detail::file_header*>(addr);
+    if (header.magic != detail::file_header::expected_magic) {
+        throw std::runtime_error("pyvec::map_file: not a pyvec file");
+    }
+    if (header.element_size != sizeof(T)) {
+        throw std::runtime_error("pyvec::map_file: element size mismatch");
+    }
+    if (header.count > (length - sizeof(header)) / sizeof(T)) {
+        throw std::runtime_error("pyvec::map_file: truncated payload");
+    }
+    const auto first = reinterpret_cast<pointer>(static_cast<char*>(addr) + sizeof(header));
+    return pyvec<T, Alloc>(std::span<T>(first, header.count), std::move(mapping), alloc);
+#else
+    return load(path, alloc);
+#endif
+}
+
+template<typename T, typename Alloc>
+void pyvec<T, Alloc>::finish_sort() {
+    _dense  = false;
+    _sorted = false;
+    index_reordered();
+    if (_relayout_sort) { relayout(); }
+}
+
+// lazy slice of a pyvec, see pyvec::view()
+template<typename T, typename Alloc = std::allocator<T>>
+using pyvec_view = typename pyvec<T, Alloc>::view_type;
+
+#if __has_include(<memory_resource>)
+namespace pmr {
+// pyvec drawing chunks, pointer table and control blocks from a std::pmr::memory_resource
+template<typename T>
+using pyvec = pycontainer::pyvec<T, std::pmr::polymorphic_allocator<T>>;
+}   // namespace pmr
+#endif
 }   // namespace pycontainer
+
+#undef PYVEC_COUNT
+#undef PYVEC_HAS_MMAP
 #endif   // PYVEC_HPP
\ No newline at end of file
@@ -0,0 +1,451 @@
+#pragma once
+#ifndef PYVEC_SOA_HPP
+#define PYVEC_SOA_HPP
+
+#include "pyvec.hpp"
+#include <tuple>
+#include <limits>
+
+namespace pycontainer {
+namespace detail {
+template<typename M>
+struct member_traits;
+
+template<typename C, typename F>
+struct member_traits<F C::*> {
+    using object_type = C;
+    using field_type  = F;
+};
+
+template<auto A, auto B>
+constexpr bool same_member() {
+    if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+        return A == B;
+    } else {
+        return false;
+    }
+}
+}   // namespace detail
+
+// pyvec for aggregates that keeps every listed field of T in a column of its own, e.g.
+// pyvec_soa<Event, &Event::ts, &Event::val>; a scan over one field then reads one array.
+// Like the pointer table of pyvec, a table of row numbers gives the logical order, so
+// slicing, filter and sort only rewrite that table, and slices and copy() share the columns.
+// Elements are assembled on access: T must be default constructible, and the fields of T
+// that are not listed are not stored and come back value-initialized.
+// Index is the unsigned type of a row number and bounds the rows the columns can hold
+template<typename Index, typename T, auto... Members>
+class basic_pyvec_soa {
+    static_assert(std::is_unsigned_v<Index>, "pyvec_soa needs an unsigned row index");
+    static_assert(sizeof...(Members) > 0, "pyvec_soa needs at least one field");
+    static_assert(
+        (std::is_same_v<typename detail::member_traits<decltype(Members)>::object_type, T> && ...),
+        "pyvec_soa fields must be data members of T"
+    );
+    static_assert(std::is_default_constructible_v<T>, "pyvec_soa needs a default constructible T");
+    // a std::vector<bool> column has no element addresses for field(), column() and spans
+    static_assert(
+        (!std::is_same_v<typename detail::member_traits<decltype(Members)>::field_type, bool> && ...),
+        "pyvec_soa cannot store bool fields, use a byte type such as std::uint8_t"
+    );
+
+public:
+    using value_type      = T;
+    using index_type      = Index;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    template<auto Member>
+    using field_type = typename detail::member_traits<decltype(Member)>::field_type;
+
+private:
+    template<typename U>
+    using shared = std::shared_ptr<U>;
+
+    // row numbers kept inline by the table
+    static constexpr size_t small_size = 8;
+    // below this size the comparison sort wins over radix passes
+    static constexpr size_t radix_threshold = 256;
+
+    // columns grow like std::vector and are only ever appended to, so they are only grown
+    // while no other instance shares them; rows never move
+    struct storage {
+        std::tuple<std::vector<field_type<Members>>...> columns;
+    };
+
+    using table = detail::ptr_table<Index, std::allocator<Index>, small_size>;
+
+    // created on the first insertion, empty instances own no columns
+    shared<storage> _storage;
+    table           _rows;
+    // true: consecutive positions refer to consecutive rows, false: unknown
+    mutable detail::cached_flag _dense = true;
+
+    template<auto Member>
+    static constexpr size_t column_index() {
+        size_t index = 0, found = sizeof...(Members);
+        ((detail::same_member<Member, Members>() ? found = index++ : index++), ...);
+        return found;
+    }
+
+public:
+    basic_pyvec_soa() = default;
+
+    template<typename InputIt>
+    basic_pyvec_soa(is_input_iterator_t<InputIt> first, InputIt last) {
+        extend<InputIt>(first, last);
+    }
+
+    basic_pyvec_soa(std::initializer_list<T> il) { extend<const T*>(il.begin(), il.end()); }
+
+    // deep copy like pyvec's: the live rows in logical order, in columns of its own
+    basic_pyvec_soa(const basic_pyvec_soa& other) { assign_rows(other); }
+    basic_pyvec_soa(basic_pyvec_soa&&) noexcept = default;
+
+    basic_pyvec_soa& operator=(const basic_pyvec_soa& other) {
+        if (this != &other) { assign_rows(other); }
+        return *this;
+    }
+    basic_pyvec_soa& operator=(basic_pyvec_soa&&) noexcept = default;
+    ~basic_pyvec_soa()                                     = default;
+
+    /*
+     *  Pyhton-List-Like Interface
+     */
+    void append(const T& value) {
+        const auto row = push_row(value);
+        if (_dense && !_rows.empty() && _rows.back() + 1 != row) { _dense = false; }
+        _rows.push_back(row);
+    }
+
+    template<typename InputIt>
+    void extend(is_input_iterator_t<InputIt> first, InputIt last) {
+        if constexpr (detail::is_forward_iterator_v<InputIt>) {
+            const auto n = static_cast<size_type>(std::distance(first, last));
+            reserve(size() + n);
+        }
+        for (; first != last; ++first) { append(*first); }
+    }
+
+    void insert(const difference_type index, const T& value) {
+        const auto pos = index >= static_cast<difference_type>(size()) ? size() : pypos(index);
+        const auto row = push_row(value);
+        if (pos != _rows.size()) { _dense = false; }
+        if (_dense && pos > 0 && _rows[pos - 1] + 1 != row) { _dense = false; }
+        *_rows.insert_gap(pos, 1) = row;
+    }
+
+    T pop(const difference_type index = -1) {
+        const auto pos = pypos(index);
+        T          ans = assemble(_rows[pos]);
+        erase_rows(pos, pos + 1);
+        return ans;
+    }
+
+    // drops the columns like pyvec::clear() drops its storage, copies keep theirs alive
+    void clear() {
+        _rows.clear();
+        _storage = nullptr;
+        _dense   = true;
+    }
+
+    // shallow copy sharing the columns, like pyvec::copy()
+    basic_pyvec_soa copy() const {
+        basic_pyvec_soa ans;
+        ans._storage = _storage;
+        ans._rows.resize(size());
+        std::copy(_rows.begin(), _rows.end(), ans._rows.begin());
+        ans._dense = _dense;
+        return ans;
+    }
+
+    // rows are kept, assembles each element once
+    template<typename Func>
+    void filter(Func func) {
+        keep_rows([&](const size_type row) { return static_cast<bool>(func(assemble(row))); });
+    }
+
+    // filter reading a single column, pred gets the field of every element
+    template<auto Member, typename Pred>
+    void filter_by(Pred pred) {
+        const auto& column = std::get<column_index<Member>()>(columns());
+        keep_rows([&](const size_type row) { return static_cast<bool>(pred(column[row])); });
+    }
+
+    // stable, key is evaluated once per element on the assembled value
+    template<typename Key>
+    void sort(Key key, const bool reverse = false) {
+        sort_rows([&](const size_type row) { return key(assemble(row)); }, reverse);
+    }
+
+    // stable sort by one field, reading only its column
+    template<auto Member>
+    void sort_by(const bool reverse = false) {
+        const auto& column = std::get<column_index<Member>()>(columns());
+        sort_rows([&](const size_type row) -> const auto& { return column[row]; }, reverse);
+    }
+
+    /*
+     *  Python Magic Method
+     */
+    [[nodiscard]] T getitem(const difference_type index) const {
+        return assemble(_rows[pypos(index)]);
+    }
+
+    // shallow copy sharing the columns
+    basic_pyvec_soa getitem(const slice& t_slice) const {
+        const auto      s = detail::build_slice(t_slice, size());
+        basic_pyvec_soa ans;
+        if (s.num_steps == 0) { return ans; }
+        ans._storage = _storage;
+        ans._dense   = s.num_steps < 2 || (s.step == 1 && _dense);
+        ans._rows.reserve(s.num_steps);
+        auto pos = static_cast<difference_type>(s.start);
+        for (size_type i = 0; i < s.num_steps; ++i, pos += s.step) {
+            ans._rows.push_back(_rows[pos]);
+        }
+        return ans;
+    }
+
+    // the element gets a new row, instances sharing the columns keep the old value
+    void setitem(const difference_type index, const T& value) {
+        const auto pos = pypos(index);
+        _rows[pos]     = push_row(value);
+        _dense         = false;
+    }
+
+    void delitem(const difference_type index) {
+        const auto pos = pypos(index);
+        erase_rows(pos, pos + 1);
+    }
+
+    /*
+     *  C++-Vector-Like Interface
+     */
+    T operator[](const size_type pos) const { return assemble(_rows[pos]); }
+
+    T at(const size_type pos) const {
+        if (pos >= size()) { throw std::out_of_range("pyvec_soa::at"); }
+        return assemble(_rows[pos]);
+    }
+
+    [[nodiscard]] bool      empty() const { return _rows.empty(); }
+    [[nodiscard]] size_type size() const { return _rows.size(); }
+
+    // room for new_cap rows in the table and every column
+    void reserve(const size_type new_cap) {
+        _rows.reserve(new_cap);
+        if (new_cap <= size()) { return; }
+        std::apply(
+            [&](auto&... column) { (column.reserve(column.size() + new_cap - size()), ...); },
+            growable_columns()
+        );
+    }
+
+    /*
+     *  Column Access
+     */
+
+    // field of the element at pos, stored in place and so seen by instances sharing the columns;
+    // anything that adds rows to this instance may invalidate it, the sharing ones never do
+    template<auto Member>
+    field_type<Member>& field(const size_type pos) {
+        return std::get<column_index<Member>()>(columns())[_rows[pos]];
+    }
+
+    template<auto Member>
+    const field_type<Member>& field(const size_type pos) const {
+        return std::get<column_index<Member>()>(columns())[_rows[pos]];
+    }
+
+    // one field of all elements in logical order, throws std::logic_error unless is_dense()
+    template<auto Member>
+    [[nodiscard]] std::span<field_type<Member>> column() {
+        if (!is_dense()) { throw std::logic_error("pyvec_soa::column: rows are not contiguous"); }
+        if (empty()) { return {}; }
+        return {std::get<column_index<Member>()>(columns()).data() + _rows.front(), size()};
+    }
+
+    template<auto Member>
+    [[nodiscard]] std::span<const field_type<Member>> column() const {
+        if (!is_dense()) { throw std::logic_error("pyvec_soa::column: rows are not contiguous"); }
+        if (empty()) { return {}; }
+        return {std::get<column_index<Member>()>(columns()).data() + _rows.front(), size()};
+    }
+
+    // call func with a std::span over the field for every maximal run of consecutive rows
+    template<auto Member, typename Func>
+    void for_each_span(Func func) {
+        visit_runs(std::get<column_index<Member>()>(columns()).data(), func);
+    }
+
+    template<auto Member, typename Func>
+    void for_each_span(Func func) const {
+        const auto* data = std::get<column_index<Member>()>(columns()).data();
+        visit_runs(data, func);
+    }
+
+    // whether the elements occupy consecutive rows in logical order
+    [[nodiscard]] bool is_dense() const {
+        if (_dense || _rows.size() < 2) { return true; }
+        for (size_type i = 1; i < _rows.size(); ++i) {
+            if (_rows[i] != _rows[0] + i) { return false; }
+        }
+        return _dense = true;
+    }
+
+    // copy the live rows, in logical order, into columns of this instance's own; dead rows
+    // are dropped and column() works afterwards
+    void relayout() { assign_rows(*this); }
+
+    std::vector<T> collect() const {
+        std::vector<T> ans;
+        ans.reserve(size());
+        for (const auto row : _rows) { ans.push_back(assemble(row)); }
+        return ans;
+    }
+
+private:
+    using columns_type = std::tuple<std::vector<field_type<Members>>...>;
+
+    void try_init() {
+        if (!_storage) { _storage = std::make_shared<storage>(); }
+    }
+
+    columns_type& columns() {
+        try_init();
+        return _storage->columns;
+    }
+
+    // columns rows may be appended to: growing shared ones would move them under the
+    // instances sharing them, so this one moves to a private set first
+    columns_type& growable_columns() {
+        if (_storage && _storage.use_count() > 1) { relayout(); }
+        return columns();
+    }
+
+    // the live rows of source in logical order, in fresh columns
+    void assign_rows(const basic_pyvec_soa& source) {
+        if (source.empty()) {
+            _storage.reset();
+            return clear();
+        }
+        auto fresh = std::make_shared<storage>();
+        source.gather(fresh->columns, std::index_sequence_for<decltype(Members)...>());
+        _rows.resize(source.size());
+        _storage = std::move(fresh);
+        std::iota(_rows.begin(), _rows.end(), Index{0});
+        _dense = true;
+    }
+
+    // empty instances read from a shared empty set of columns
+    const columns_type& columns() const {
+        static const columns_type none;
+        return _storage ? _storage->columns : none;
+    }
+
+    Index push_row(const T& value) {
+        auto&      all = growable_columns();
+        const auto row = std::get<0>(all).size();
+        if (row > std::numeric_limits<Index>::max()) {
+            throw std::length_error("pyvec_soa: rows exceed the index type");
+        }
+        std::apply([&](auto&... column) { (column.push_back(value.*Members), ...); }, all);
+        return static_cast<Index>(row);
+    }
+
+    T assemble(const size_type row) const {
+        T ans{};
+        std::apply([&](const auto&... column) { ((ans.*Members = column[row]), ...); }, columns());
+        return ans;
+    }
+
+    template<size_t... I>
+    void gather(columns_type& target, std::index_sequence<I...>) const {
+        (gather_column(std::get<I>(target), std::get<I>(_storage->columns)), ...);
+    }
+
+    template<typename Column>
+    void gather_column(Column& target, const Column& source) const {
+        target.reserve(size());
+        for (const auto row : _rows) { target.push_back(source[row]); }
+    }
+
+    void erase_rows(const size_type left, const size_type right) {
+        if (left != 0 && right != _rows.size()) { _dense = false; }
+        _rows.erase(_rows.begin() + left, _rows.begin() + right);
+    }
+
+    template<typename Keep>
+    void keep_rows(Keep keep) {
+        auto it = std::remove_if(_rows.begin(), _rows.end(), [&](const size_type row) {
+            return !keep(row);
+        });
+        if (it != _rows.end()) { _dense = false; }
+        _rows.erase(it, _rows.end());
+    }
+
+    template<typename Key>
+    void sort_rows(Key key, const bool reverse) {
+        using key_type = std::decay_t<std::invoke_result_t<Key&, size_type>>;
+        if constexpr (detail::radix_sortable_v<key_type>) {
+            if (size() >= radix_threshold) {
+                using radix_type = decltype(detail::radix_key(std::declval<key_type>()));
+                std::vector<std::pair<radix_type, Index>> decorated;
+                decorated.reserve(size());
+                for (const auto row : _rows) {
+                    const auto k = detail::radix_key(static_cast<key_type>(key(row)));
+                    // inverting the key sorts descending while equal keys keep their order
+                    decorated.emplace_back(reverse ? static_cast<radix_type>(~k) : k, row);
+                }
+                detail::radix_sort(decorated.data(), decorated.size());
+                return undecorate(decorated);
+            }
+        }
+        using item = std::pair<key_type, Index>;
+        std::vector<item> decorated;
+        decorated.reserve(size());
+        for (const auto row : _rows) { decorated.emplace_back(key(row), row); }
+        auto cmp = [](const item& a, const item& b) { return a.first < b.first; };
+        if (reverse) {
+            gfx::timsort(decorated.rbegin(), decorated.rend(), cmp);
+        } else {
+            gfx::timsort(decorated.begin(), decorated.end(), cmp);
+        }
+        undecorate(decorated);
+    }
+
+    template<typename Decorated>
+    void undecorate(const Decorated& decorated) {
+        auto target = _rows.data();
+        for (const auto& [_, row] : decorated) { *target++ = row; }
+        _dense = false;
+    }
+
+    template<typename F, typename Func>
+    void visit_runs(F* data, Func& func) const {
+        const auto n = _rows.size();
+        for (size_type first = 0, last = 0; first < n; first = last) {
+            for (last = first + 1; last < n && _rows[last] == _rows[last - 1] + 1; ++last) {}
+            func(std::span<F>(data + _rows[first], last - first));
+        }
+    }
+
+    [[nodiscard]] size_type pypos(const difference_type index) const {
+        difference_type ans = index;
+        if (ans < 0) { ans += static_cast<difference_type>(size()); }
+        if (ans < 0 || ans >= static_cast<difference_type>(size())) {
+            throw std::out_of_range("pyvec_soa::index out of range: " + std::to_string(index));
+        }
+        return static_cast<size_type>(ans);
+    }
+};
+
+template<typename T, auto... Members>
+using pyvec_soa = basic_pyvec_soa<std::size_t, T, Members...>;
+
+// 4 byte row numbers, half the table of pyvec_soa, for up to 2^32 rows per set of columns
+template<typename T, auto... Members>
+using compact_pyvec_soa = basic_pyvec_soa<std::uint32_t, T, Members...>;
+}   // namespace pycontainer
+
+#endif   // PYVEC_SOA_HPP
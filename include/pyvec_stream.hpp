@@ -0,0 +1,202 @@
+#pragma once
+#ifndef PYVEC_STREAM_HPP
+#define PYVEC_STREAM_HPP
+
+#include "pyvec.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+
+namespace pycontainer {
+// bounded pipeline buffer between one producer thread and any number of consumers.
+// The producer appends into a chunk reserved for batch_size elements; once full it is
+// committed as a batch, a pyvec owning just that chunk, so nothing is copied on the way and
+// elements never move. Consumers poll, block or co_await batches; dropping a batch, and every
+// handle into it, frees its chunk. With max_batches committed and unclaimed, append blocks
+template<typename T, typename Alloc = std::allocator<T>>
+class pyvec_stream {
+public:
+    using value_type = T;
+    using size_type  = std::size_t;
+    using batch_type = pyvec<T, Alloc>;
+
+private:
+    // a suspended consumer, handed its batch by the producer before it is resumed
+    struct waiter {
+        std::coroutine_handle<>   handle;
+        std::optional<batch_type> batch;
+    };
+
+    using buffer = std::vector<T, Alloc>;
+
+    Alloc     _alloc;
+    size_type _batch_size;
+    size_type _max_batches;
+    // producer side, only touched by the producer thread
+    buffer _pending;
+
+    mutable std::mutex      _lock;
+    std::condition_variable _ready;
+    std::condition_variable _space;
+    std::deque<batch_type>  _batches;
+    std::deque<waiter*>     _waiters;
+    bool                    _closed = false;
+
+public:
+    class awaiter;
+
+    // max_batches == 0 leaves the stream unbounded
+    explicit pyvec_stream(
+        const size_type batch_size, const size_type max_batches = 0, const Alloc& alloc = Alloc()
+    ) :
+        _alloc(alloc), _batch_size(std::max<size_type>(1, batch_size)), _max_batches(max_batches),
+        _pending(alloc) {}
+
+    pyvec_stream(const pyvec_stream&)            = delete;
+    pyvec_stream& operator=(const pyvec_stream&) = delete;
+
+    /*
+     *  Producer
+     */
+
+    void append(const T& value) { emplace_back(value); }
+    void append(T&& value) { emplace_back(std::move(value)); }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+        if (_pending.capacity() == 0) { _pending.reserve(_batch_size); }
+        _pending.emplace_back(std::forward<Args>(args)...);
+        if (_pending.size() == _batch_size) { commit(); }
+    }
+
+    // commit the elements appended so far as a shorter batch
+    void flush() {
+        if (!_pending.empty()) { commit(); }
+    }
+
+    // flush and end the stream: consumers get the remaining batches, then nothing
+    void close() {
+        flush();
+        std::deque<waiter*> woken;
+        {
+            std::lock_guard guard(_lock);
+            _closed = true;
+            woken.swap(_waiters);
+        }
+        _ready.notify_all();
+        for (auto* w : woken) { w->handle.resume(); }
+    }
+
+    /*
+     *  Consumer
+     */
+
+    // the oldest committed batch, or nullopt if there is none right now
+    std::optional<batch_type> try_pop() {
+        std::unique_lock guard(_lock);
+        return take(guard);
+    }
+
+    // wait for a batch, nullopt once the stream is closed and drained
+    std::optional<batch_type> pop() {
+        std::unique_lock guard(_lock);
+        _ready.wait(guard, [this] { return !_batches.empty() || _closed; });
+        return take(guard);
+    }
+
+    // co_await next() gives what pop() would without blocking the thread; the coroutine is
+    // resumed on the producer's thread, inside append(), flush() or close()
+    awaiter next() { return awaiter(*this); }
+
+    [[nodiscard]] size_type batch_size() const { return _batch_size; }
+
+    // committed batches nobody has taken yet
+    [[nodiscard]] size_type ready() const {
+        std::lock_guard guard(_lock);
+        return _batches.size();
+    }
+
+    [[nodiscard]] bool closed() const {
+        std::lock_guard guard(_lock);
+        return _closed;
+    }
+
+private:
+    void commit() {
+        batch_type batch(std::move(_pending));
+        _pending = buffer(_alloc);
+        std::unique_lock guard(_lock);
+        if (!_waiters.empty()) {
+            // hand it straight to a suspended consumer, it never occupies the queue
+            auto* w = _waiters.front();
+            _waiters.pop_front();
+            w->batch.emplace(std::move(batch));
+            guard.unlock();
+            return w->handle.resume();
+        }
+        if (_max_batches != 0) {
+            _space.wait(guard, [this] { return _batches.size() < _max_batches; });
+        }
+        _batches.push_back(std::move(batch));
+        guard.unlock();
+        _ready.notify_one();
+    }
+
+    std::optional<batch_type> take(std::unique_lock<std::mutex>& guard) {
+        if (_batches.empty()) { return std::nullopt; }
+        std::optional<batch_type> ans(std::move(_batches.front()));
+        _batches.pop_front();
+        guard.unlock();
+        _space.notify_one();
+        return ans;
+    }
+};
+
+template<typename T, typename Alloc>
+class pyvec_stream<T, Alloc>::awaiter {
+    friend class pyvec_stream;
+    pyvec_stream* _stream;
+    waiter        _waiter;
+
+    explicit awaiter(pyvec_stream& stream) : _stream(&stream) {}
+
+public:
+    awaiter(const awaiter&)            = delete;
+    awaiter& operator=(const awaiter&) = delete;
+
+    // a coroutine destroyed while suspended here leaves the queue, the stream must outlive it
+    ~awaiter() {
+        if (!_waiter.handle) { return; }
+        std::lock_guard guard(_stream->_lock);
+        auto&           waiters = _stream->_waiters;
+        const auto      it      = std::find(waiters.begin(), waiters.end(), &_waiter);
+        if (it != waiters.end()) { waiters.erase(it); }
+    }
+
+    bool await_ready() {
+        _waiter.batch = _stream->try_pop();
+        return _waiter.batch.has_value();
+    }
+
+    bool await_suspend(const std::coroutine_handle<> handle) {
+        std::unique_lock guard(_stream->_lock);
+        // a batch or close() may have come in since await_ready
+        if (!_stream->_batches.empty() || _stream->_closed) {
+            _waiter.batch = _stream->take(guard);
+            return false;
+        }
+        _waiter.handle = handle;
+        _stream->_waiters.push_back(&_waiter);
+        return true;
+    }
+
+    std::optional<batch_type> await_resume() {
+        // handed over and resumed, no longer queued
+        _waiter.handle = nullptr;
+        return std::move(_waiter.batch);
+    }
+};
+}   // namespace pycontainer
+
+#endif   // PYVEC_STREAM_HPP
@@ -2,10 +2,21 @@
 // Created by lyk on 24-3-9.
 //
 #include "pyvec.hpp"
+#include "compact_pyvec.hpp"
+#include "pyvec_soa.hpp"
+#include "pyvec_stream.hpp"
 #include <list>
 #include <catch2/catch_test_macros.hpp>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <memory>
+#include <sstream>
+#include <iterator>
+#include <thread>
+#include <filesystem>
+#include <random>
 
 using std::nullopt;
 using namespace pycontainer;
@@ -421,4 +432,1765 @@ TEST_CASE("python interface") {
         v.delitem({nullopt, nullopt, -1});
         REQUIRE(v.collect().empty());
     }
-}
\ No newline at end of file
+}
+TEST_CASE("compaction", "[pyvec]") {
+    pyvec<int> v{};
+    for (int i = 0; i < 1000; ++i) { v.push_back(i); }
+    v.filter([](int a) { return a % 10 == 0; });
+    const auto expected = v.collect();
+
+    SECTION("manual") {
+        const auto before = v.capacity();
+        REQUIRE(v.compact());
+        REQUIRE(v.capacity() < before);
+        REQUIRE(v.capacity() >= v.size());
+        REQUIRE(v.collect() == expected);
+        v.push_back(1000);
+        REQUIRE(v.back() == 1000);
+    }
+
+    SECTION("shared storage is kept alive") {
+        auto copy  = v.copy();
+        auto slice = v.getitem({0, 10, 1});
+        REQUIRE(!v.compact());
+        REQUIRE(copy.collect() == expected);
+        copy  = pyvec<int>{};
+        slice = pyvec<int>{};
+        {
+            auto handle = v.getitem(3);
+            REQUIRE(!v.compact());
+            REQUIRE(*handle == 30);
+        }
+        REQUIRE(v.compact());
+        REQUIRE(v.collect() == expected);
+    }
+
+    SECTION("automatic") {
+        REQUIRE_THROWS(v.set_compact_threshold(1.5));
+        v.set_compact_threshold(0.5);
+        REQUIRE(v.compact_threshold() == 0.5);
+        REQUIRE(v.capacity() < 1000);
+        for (int i = 0; i < 10000; ++i) {
+            v.push_back(i);
+            v.erase(v.end() - 1);
+        }
+        REQUIRE(v.collect() == expected);
+        REQUIRE(v.capacity() < 1000);
+    }
+}
+
+TEST_CASE("key cached sort", "[pyvec]") {
+    pyvec<std::pair<int, int>> v{};
+    for (int i = 0; i < 200; ++i) { v.push_back({(i * 37) % 11, i}); }
+    auto expected = v.collect();
+    auto by_first = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.first < b.first;
+    };
+
+    size_t calls = 0;
+    auto   key   = [&calls](const std::pair<int, int>& a) {
+        ++calls;
+        return std::string(a.first, 'k');
+    };
+
+    SECTION("ascending") {
+        v.sort_cached(key, false);
+        std::stable_sort(expected.begin(), expected.end(), by_first);
+        REQUIRE(calls == v.size());
+        REQUIRE(v.collect() == expected);
+    }
+
+    SECTION("descending keeps stability") {
+        auto reference = v.copy();
+        reference.sort([](const std::pair<int, int>& a) { return a.first; }, true);
+        v.sort_cached(key, true);
+        REQUIRE(calls == v.size());
+        REQUIRE(v.collect() == reference.collect());
+    }
+
+    SECTION("shared") {
+        v.sort_shared_cached(
+            [&calls](const std::shared_ptr<std::pair<int, int>>& a) {
+                ++calls;
+                return a->first;
+            },
+            false
+        );
+        std::stable_sort(expected.begin(), expected.end(), by_first);
+        REQUIRE(calls == v.size());
+        REQUIRE(v.collect() == expected);
+    }
+}
+
+TEST_CASE("radix sort", "[pyvec]") {
+    std::vector<int>    ints;
+    std::vector<double> doubles;
+    uint64_t            seed = 42;
+    for (int i = 0; i < 5000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        ints.push_back(static_cast<int>(seed >> 33) - (1 << 30));
+        doubles.push_back(static_cast<double>(ints.back()) / 7.0);
+    }
+    doubles[0] = -0.0;
+    doubles[1] = 0.0;
+
+    SECTION("integers") {
+        pyvec<int> v(ints.begin(), ints.end());
+        v.sort();
+        std::sort(ints.begin(), ints.end());
+        REQUIRE(v.collect() == ints);
+        v.sort(true);
+        std::sort(ints.begin(), ints.end(), std::greater<>{});
+        REQUIRE(v.collect() == ints);
+    }
+
+    SECTION("floating point") {
+        pyvec<double> v(doubles.begin(), doubles.end());
+        v.sort();
+        std::sort(doubles.begin(), doubles.end());
+        REQUIRE(v.collect() == doubles);
+    }
+
+    SECTION("stable with arithmetic keys") {
+        using item = std::pair<int8_t, int>;
+        std::vector<item> items;
+        for (int i = 0; i < 5000; ++i) { items.emplace_back(static_cast<int8_t>(ints[i] % 7), i); }
+        pyvec<item> v(items.begin(), items.end());
+        auto        key = [](const item& a) { return a.first; };
+
+        v.sort(key, false);
+        std::stable_sort(items.begin(), items.end(), [](const item& a, const item& b) {
+            return a.first < b.first;
+        });
+        REQUIRE(v.collect() == items);
+
+        v.sort_cached(key, true);
+        std::stable_sort(items.begin(), items.end(), [](const item& a, const item& b) {
+            return a.first > b.first;
+        });
+        REQUIRE(v.collect() == items);
+    }
+}
+
+TEST_CASE("parallel sort", "[pyvec]") {
+    using item = std::pair<int, int>;
+    std::vector<item> items;
+    uint64_t          seed = 7;
+    for (int i = 0; i < 30000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        items.emplace_back(static_cast<int>(seed >> 40) % 1000 - 500, i);
+    }
+    pyvec<item> v(items.begin(), items.end());
+    auto        serial = v.deepcopy();
+
+    SECTION("arithmetic key") {
+        auto key = [](const item& a) { return a.first; };
+        for (const bool reverse : {false, true}) {
+            for (const size_t threads : {2, 3, 5}) {
+                auto parallel = v.deepcopy();
+                parallel.sort_parallel(key, reverse, threads);
+                serial.sort(key, reverse);
+                REQUIRE(parallel.collect() == serial.collect());
+            }
+        }
+    }
+
+    SECTION("generic key") {
+        auto key = [](const item& a) { return std::to_string(a.first); };
+        for (const bool reverse : {false, true}) {
+            auto parallel = v.deepcopy();
+            parallel.sort_parallel(key, reverse, 4);
+            serial.sort(key, reverse);
+            REQUIRE(parallel.collect() == serial.collect());
+        }
+    }
+
+    SECTION("identity") {
+        v.sort_parallel(true, 4);
+        std::sort(items.begin(), items.end(), std::greater<>{});
+        REQUIRE(v.collect() == items);
+    }
+}
+
+TEST_CASE("relayout", "[pyvec]") {
+    std::vector<int> data;
+    for (int i = 0; i < 500; ++i) { data.push_back((i * 7919) % 500); }
+    pyvec<int> v(data.begin(), data.end());
+    REQUIRE(v.is_dense());
+
+    v.sort();
+    REQUIRE(!v.is_dense());
+    auto shallow = v.copy();
+    v.relayout();
+    REQUIRE(v.is_dense());
+    REQUIRE(v.is_sorted());
+    REQUIRE(shallow.collect() == v.collect());
+    REQUIRE(!shallow.is_dense());   // siblings keep the old chunks
+    REQUIRE(&shallow[0] != &v[0]);
+
+    v.set_relayout_on_sort(true);
+    REQUIRE(v.relayout_on_sort());
+    v.sort(true);
+    REQUIRE(v.is_dense());
+    REQUIRE(v.front() == 499);
+    v.reverse();
+    REQUIRE(!v.is_dense());
+    v.sort_cached([](int a) { return -a; }, false);
+    REQUIRE(v.is_dense());
+    REQUIRE(v.back() == 0);
+}
+
+TEST_CASE("contiguous spans", "[pyvec]") {
+    std::vector<int> data(300);
+    for (int i = 0; i < 300; ++i) { data[i] = i % 17; }
+    pyvec<int> v(data.begin(), data.end());
+
+    auto spans = [](const pyvec<int>& pv) {
+        std::vector<size_t> sizes;
+        pv.for_each_span([&sizes](std::span<const int> span) { sizes.push_back(span.size()); });
+        return sizes;
+    };
+    REQUIRE(spans(v) == std::vector<size_t>{300});
+
+    v.push_back(17);
+    v.insert(v.begin() + 100, 18);
+    REQUIRE(spans(v).size() == 4);
+    REQUIRE(v.index(18) == 100);
+    REQUIRE(v.index(17) == 301);
+    REQUIRE(v.index(3, 50) == 54);
+    REQUIRE(v.count(16) == static_cast<size_t>(std::count(data.begin(), data.end(), 16)));
+    REQUIRE(v.contains(18));
+    REQUIRE(!v.contains(19));
+
+    auto copy = v.deepcopy();
+    REQUIRE(copy == v);
+    REQUIRE(spans(copy) == std::vector<size_t>{302});
+    copy[301] = 0;
+    REQUIRE(copy != v);
+
+    // rewriting the pointer table by hand is picked up
+    std::reverse(v.pbegin(), v.pend());
+    REQUIRE(v.front() == 17);
+    REQUIRE(spans(v).size() == 302);
+    REQUIRE(v.index(18) == 201);
+
+    long sum = 0;
+    v.for_each_span([&sum](std::span<int> span) {
+        for (auto& x : span) { sum += x; }
+    });
+    REQUIRE(sum == std::accumulate(data.begin(), data.end(), 0L) + 35);
+}
+
+TEST_CASE("vectorized search", "[pyvec]") {
+    std::vector<int32_t> data(1000);
+    for (int i = 0; i < 1000; ++i) { data[i] = (i * 31) % 97; }
+    pyvec<int32_t> dense(data.begin(), data.end());
+    auto           scattered = dense.copy();
+    scattered.sort();   // pointer table no longer follows memory order
+    auto mixed = dense.deepcopy();
+    for (int i = 0; i < 1000; i += 100) { mixed.insert(mixed.begin() + i, 1000 + i); }
+
+    std::vector<int32_t> sorted = data;
+    std::sort(sorted.begin(), sorted.end());
+    const auto mixed_data = mixed.collect();
+
+    for (const int32_t value : {0, 5, 42, 96, 97, 1500}) {
+        const auto cnt = static_cast<size_t>(std::count(data.begin(), data.end(), value));
+        REQUIRE(dense.count(value) == cnt);
+        REQUIRE(scattered.count(value) == cnt);
+        REQUIRE(
+            mixed.count(value) ==
+            static_cast<size_t>(std::count(mixed_data.begin(), mixed_data.end(), value))
+        );
+        REQUIRE(dense.contains(value) == (cnt > 0));
+        REQUIRE(scattered.contains(value) == (cnt > 0));
+        if (cnt > 0) {
+            const auto first = [value](const std::vector<int32_t>& v, const size_t start) {
+                return static_cast<size_t>(std::find(v.begin() + start, v.end(), value) - v.begin());
+            };
+            REQUIRE(dense.index(value) == first(data, 0));
+            REQUIRE(scattered.index(value) == first(sorted, 0));
+            REQUIRE(mixed.index(value, 3) == first(mixed_data, 3));
+        } else {
+            REQUIRE_THROWS(scattered.index(value));
+        }
+    }
+    REQUIRE(mixed.index(1500) == 500);
+
+    pyvec<double> reals{0.5, -0.0, 1.5};
+    REQUIRE(reals.contains(0.0));
+    REQUIRE(reals.index(1.5) == 2);
+}
+
+#if defined(__cpp_lib_memory_resource)
+struct counting_resource : std::pmr::memory_resource {
+    size_t allocated = 0;
+    size_t live      = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        allocated += bytes;
+        live += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        live -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    [[nodiscard]] bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST_CASE("polymorphic allocator", "[pyvec]") {
+    counting_resource resource;
+    {
+        pycontainer::pmr::pyvec<std::pmr::string> list(&resource);
+        for (int i = 0; i < 200; ++i) { list.append(std::pmr::string(40, char('a' + i % 26))); }
+        REQUIRE(list.get_allocator().resource() == &resource);
+        REQUIRE(resource.allocated > 200 * 40);
+        REQUIRE(list[3] == std::pmr::string(40, 'd'));
+
+        // elements receive the list's resource through uses-allocator construction
+        REQUIRE(list[0].get_allocator().resource() == &resource);
+
+        auto copy = list.copy();
+        REQUIRE(copy.get_allocator().resource() == &resource);
+        auto slice = list.getitem({0, 10, 1});
+        REQUIRE(slice.get_allocator().resource() == &resource);
+
+        list.sort();
+        list.relayout();
+        REQUIRE(list.is_dense());
+        REQUIRE(list.collect().get_allocator().resource() == &resource);
+    }
+    REQUIRE(resource.live == 0);
+}
+#endif
+
+template<typename T>
+struct counting_allocator {
+    using value_type = T;
+
+    std::shared_ptr<size_t> count = std::make_shared<size_t>(0);
+
+    counting_allocator() = default;
+
+    template<typename U>
+    counting_allocator(const counting_allocator<U>& other) : count(other.count) {}
+
+    T* allocate(size_t n) {
+        ++*count;
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) { std::allocator<T>{}.deallocate(p, n); }
+
+    template<typename U>
+    bool operator==(const counting_allocator<U>& other) const {
+        return count == other.count;
+    }
+};
+
+TEST_CASE("custom allocator", "[pyvec]") {
+    counting_allocator<int>                     alloc;
+    pycontainer::pyvec<int, counting_allocator<int>> list({3, 1, 2}, alloc);
+    const auto                                  before = *alloc.count;
+    REQUIRE(before > 0);
+    for (int i = 0; i < 100; ++i) { list.append(i); }
+    REQUIRE(*alloc.count > before);
+    list.sort();
+    REQUIRE(list[0] == 0);
+    REQUIRE(list.get_allocator() == alloc);
+
+    auto copy = pycontainer::pyvec<int, counting_allocator<int>>(list);
+    REQUIRE(copy == list);
+}
+
+TEST_CASE("shared storage", "[pyvec]") {
+    pyvec<int> list{1, 2, 3};
+    auto       handle = list.getitem(0);
+    REQUIRE(handle.use_count() == 2);
+    {
+        auto copy  = list.copy();
+        auto slice = list.getitem({0, 2, 1});
+        // one control block per chunk list, however many views
+        REQUIRE(handle.use_count() == 4);
+
+        // grow the chunk list through the copy until it reallocates
+        for (int i = 0; i < 5000; ++i) { copy.append(i); }
+        for (int i = 0; i < 100; ++i) { list.append(-i); }
+        REQUIRE(list.size() == 103);
+        REQUIRE(list[102] == -99);
+        REQUIRE(copy.size() == 5003);
+        REQUIRE(copy[5002] == 4999);
+        REQUIRE(slice.collect() == std::vector<int>{1, 2});
+    }
+    REQUIRE(handle.use_count() == 2);
+    REQUIRE(*handle == 1);
+}
+
+TEST_CASE("small pyvec", "[pyvec]") {
+    counting_allocator<int>                          alloc;
+    pycontainer::pyvec<int, counting_allocator<int>> list(alloc);
+    REQUIRE(*alloc.count == 0);
+    REQUIRE(list.capacity() == 0);
+    auto empty_copy = list.copy();
+    list.clear();
+    REQUIRE(*alloc.count == 0);
+
+    // control block, chunk list and one small chunk, the pointers stay inline
+    for (int i = 0; i < 5; ++i) { list.append(i); }
+    REQUIRE(*alloc.count == 3);
+    REQUIRE(list.capacity() == 8);
+    REQUIRE(list.is_dense());
+
+    const int* first = &list[0];
+    auto       moved = std::move(list);
+    REQUIRE(&moved[0] == first);
+    REQUIRE(moved.collect() == std::vector<int, counting_allocator<int>>({0, 1, 2, 3, 4}, alloc));
+    auto shallow = moved.copy();
+    REQUIRE(&shallow[4] == &moved[4]);
+
+    for (int i = 5; i < 40; ++i) { moved.append(i); }
+    REQUIRE(moved.size() == 40);
+    REQUIRE(moved[39] == 39);
+    REQUIRE(shallow.size() == 5);
+    moved.remove(0);
+    moved.shrink_to_fit();
+    REQUIRE(moved[0] == 1);
+    REQUIRE(moved.size() == 39);
+}
+
+TEST_CASE("bulk moves", "[pyvec]") {
+    using heavy = std::vector<int>;
+    pyvec<heavy> list{heavy(10, 1), heavy(10, 2)};
+
+    SECTION("adopt a vector") {
+        std::vector<heavy> src(100, heavy(10, 3));
+        const auto         buffer = src.data();
+        list.extend(std::move(src));
+        REQUIRE(list.size() == 102);
+        REQUIRE(&list[2] == buffer);
+        REQUIRE(list[101] == heavy(10, 3));
+    }
+
+    SECTION("adopt a pyvec") {
+        pyvec<heavy> other;
+        for (int i = 0; i < 100; ++i) { other.append(heavy(i, i)); }
+        const auto first = &other[0];
+        const auto last  = &other[99];
+        list.extend(std::move(other));
+        REQUIRE(other.empty());
+        REQUIRE(list.size() == 102);
+        REQUIRE(&list[2] == first);
+        REQUIRE(&list[101] == last);
+        REQUIRE(list[101] == heavy(99, 99));
+
+        pyvec<heavy> empty;
+        empty.extend(std::move(list));
+        REQUIRE(empty.size() == 102);
+        REQUIRE(&empty[101] == last);
+    }
+
+    SECTION("shared source is copied") {
+        pyvec<heavy> other{heavy(3, 7)};
+        auto         handle = other.getitem(0);
+        list.extend(std::move(other));
+        REQUIRE(list.size() == 3);
+        REQUIRE(*handle == heavy(3, 7));
+        REQUIRE(&list[2] != handle.get());
+    }
+
+    SECTION("move iterators") {
+        std::vector<heavy> src(5, heavy(4, 4));
+        list.extend(std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+        REQUIRE(list.size() == 7);
+        REQUIRE(src[0].empty());
+    }
+
+    SECTION("self extend") {
+        list.extend(list);
+        REQUIRE(list.size() == 4);
+        REQUIRE(list[3] == heavy(10, 2));
+        list.extend(std::move(list));
+        REQUIRE(list.size() == 8);
+        list.insert(list.cbegin() + 1, list.cbegin(), list.cend());
+        REQUIRE(list.size() == 16);
+        REQUIRE(list[1] == heavy(10, 1));
+        REQUIRE(list[8] == heavy(10, 2));
+    }
+
+    SECTION("single pass input") {
+        std::istringstream in("1 2 3 4");
+        pyvec<int>         ints;
+        ints.extend(std::istream_iterator<int>(in), std::istream_iterator<int>());
+        REQUIRE(ints.collect() == std::vector<int>{1, 2, 3, 4});
+    }
+}
+
+TEST_CASE("growth policy", "[pyvec]") {
+    SECTION("free index reuses abandoned chunks") {
+        pyvec<int> list;
+        list.append(0);   // first chunk holds 8, 7 stay free
+        std::vector<int> block(100, 1);
+        list.extend(block.begin(), block.end());
+        const auto capacity = list.capacity();
+        for (int i = 0; i < 7; ++i) { list.append(i); }
+        REQUIRE(list.capacity() == capacity);
+        list.append(7);
+        REQUIRE(list.capacity() > capacity);
+        REQUIRE(list.size() == 109);
+        REQUIRE(list[107] == 6);
+    }
+
+    SECTION("factor and max chunk bytes") {
+        pyvec<int> list;
+        list.set_growth_policy({1.5, 1024, false});
+        REQUIRE(list.get_growth_policy().max_chunk_bytes == 1024);
+        size_t last = 0;
+        for (int i = 0; i < 5000; ++i) {
+            list.append(i);
+            REQUIRE(list.capacity() - last <= 256);
+            last = list.capacity();
+        }
+        REQUIRE(list[4999] == 4999);
+        // a single bulk insertion still lands in one chunk
+        std::vector<int> block(1000, 3);
+        list.extend(block.begin(), block.end());
+        REQUIRE(list.size() == 6000);
+        REQUIRE_THROWS_AS(list.set_growth_policy({1.0}), std::invalid_argument);
+    }
+
+    SECTION("page aligned chunks") {
+        pyvec<int64_t> list;
+        list.set_growth_policy({2, 0, true});
+        for (int i = 0; i < 3000; ++i) {
+            list.append(i);
+            REQUIRE(list.capacity() * sizeof(int64_t) % 4096 == 0);
+        }
+        REQUIRE(list[2999] == 2999);
+    }
+
+    SECTION("setitem churn") {
+        pyvec<int> list;
+        list.assign(100, 0);
+        for (int round = 0; round < 200; ++round) {
+            std::vector<int> block(round % 13 + 1, round);
+            list.setitem({0, 5, 1}, block.begin(), block.end());
+            list.append(round);
+        }
+        REQUIRE(list.back() == 199);
+        REQUIRE(list.capacity() < 8192);
+    }
+}
+
+TEST_CASE("reserve and free capacity", "[pyvec]") {
+    counting_allocator<int>                          alloc;
+    pycontainer::pyvec<int, counting_allocator<int>> list({1, 2, 3, 4, 5}, alloc);
+    REQUIRE(list.free_capacity() == 0);
+
+    const auto allocations = *alloc.count;
+    list.reserve(3);   // smaller than size, must not allocate
+    list.reserve(list.capacity());
+    REQUIRE(*alloc.count == allocations);
+
+    list.reserve(1000);
+    REQUIRE(list.capacity() == 1000);
+    REQUIRE(list.free_capacity() == 995);
+    const auto reserved = *alloc.count;
+    const auto usage    = list.memory_usage();
+    REQUIRE(usage >= 1000 * (sizeof(int) + sizeof(int*)));
+    for (int i = 0; i < 995; ++i) { list.append(i); }
+    REQUIRE(*alloc.count == reserved);
+    REQUIRE(list.memory_usage() == usage);
+    REQUIRE(list.free_capacity() == 0);
+    list.reserve(1000);
+    REQUIRE(*alloc.count == reserved);
+
+    SECTION("shrink keeps elements in place") {
+        pyvec<int> partial;
+        for (int i = 0; i < 5; ++i) { partial.append(i); }   // 3 slots of the first chunk stay free
+        partial.reserve(500);
+        const int* first = &partial[0];
+        const auto before = partial.memory_usage();
+        partial.shrink_to_fit();
+        REQUIRE(&partial[0] == first);
+        REQUIRE(partial.memory_usage() < before);
+        REQUIRE(partial.capacity() >= partial.size());
+        partial.append(5);
+        REQUIRE(partial.collect() == std::vector<int>{0, 1, 2, 3, 4, 5});
+    }
+
+    SECTION("a shared block has no free slots under copy-on-write") {
+        pyvec<int> writer;
+        writer.set_copy_on_write(true);
+        writer.reserve(100);
+        writer.append(1);
+        REQUIRE(writer.free_capacity() == 99);
+        {
+            const auto snapshot = writer.copy();
+            REQUIRE(writer.free_capacity() == 0);
+        }
+        REQUIRE(writer.free_capacity() == 99);
+    }
+}
+
+TEST_CASE("copy on write", "[pyvec]") {
+    pyvec<int> writer;
+    writer.set_copy_on_write(true);
+    for (int i = 0; i < 5; ++i) { writer.append(i); }   // first chunk keeps free slots
+    auto snapshot = writer.copy();
+    REQUIRE(snapshot.copy_on_write());
+    const auto capacity = snapshot.capacity();
+    const int* first    = &writer[0];
+
+    writer.append(5);
+    writer.insert(writer.cbegin(), -1);
+    REQUIRE(writer.collect() == std::vector<int>{-1, 0, 1, 2, 3, 4, 5});
+    REQUIRE(&writer[1] == first);   // existing elements stay shared
+    REQUIRE(snapshot.capacity() == capacity);
+    REQUIRE(snapshot.collect() == std::vector<int>{0, 1, 2, 3, 4});
+
+    // the snapshot detaches as well, without touching the writer
+    snapshot.append(100);
+    REQUIRE(snapshot.collect() == std::vector<int>{0, 1, 2, 3, 4, 100});
+    REQUIRE(writer.size() == 7);
+
+    SECTION("elements outlive the original block") {
+        auto handle = writer.getitem(1);
+        snapshot    = pyvec<int>{};
+        writer.compact();
+        REQUIRE(*handle == 0);
+        REQUIRE(writer.collect() == std::vector<int>{-1, 0, 1, 2, 3, 4, 5});
+    }
+
+    SECTION("exclusive again once the copies are gone") {
+        snapshot = pyvec<int>{};
+        REQUIRE(writer.compact());
+        REQUIRE(writer.is_dense());
+        REQUIRE(writer.collect() == std::vector<int>{-1, 0, 1, 2, 3, 4, 5});
+    }
+
+    SECTION("exclusive again after repeated detaches") {
+        auto second = writer.copy();
+        writer.append(6);
+        auto third = writer.copy();
+        writer.append(7);
+        REQUIRE(!writer.compact());
+        snapshot = pyvec<int>{};
+        second   = pyvec<int>{};
+        REQUIRE(!writer.compact());
+        third = pyvec<int>{};
+        REQUIRE(writer.compact());
+        REQUIRE(writer.collect() == std::vector<int>{-1, 0, 1, 2, 3, 4, 5, 6, 7});
+        REQUIRE(writer.stats().chunks == 1);
+    }
+
+    SECTION("a long chain of snapshots is released") {
+        std::vector<pyvec<int>> snapshots;
+        for (int i = 0; i < 100000; ++i) {
+            snapshots.push_back(writer.getitem(slice(-1, std::nullopt)));
+            writer.append(i);
+        }
+        snapshots.clear();
+        snapshot = pyvec<int>{};
+        REQUIRE(writer.compact());
+        REQUIRE(writer.size() == 100007);
+    }
+
+    SECTION("without copy on write storage is shared") {
+        pyvec<int> plain{1, 2, 3};
+        plain.reserve(10);
+        auto copy = plain.copy();
+        plain.append(4);
+        REQUIRE(copy.capacity() == plain.capacity());
+    }
+}
+
+TEST_CASE("copy on write snapshots across threads", "[pyvec]") {
+    pyvec<int> writer;
+    writer.set_copy_on_write(true);
+    for (int i = 0; i < 1000; ++i) { writer.append(i); }
+    const auto snapshot = writer.copy();
+
+    std::vector<std::thread> readers;
+    std::vector<long long>   sums(4, 0);
+    for (size_t t = 0; t < sums.size(); ++t) {
+        readers.emplace_back([&snapshot, &sums, t] {
+            for (int round = 0; round < 20; ++round) {
+                sums[t] = std::accumulate(snapshot.begin(), snapshot.end(), 0LL);
+            }
+        });
+    }
+    for (int i = 0; i < 20000; ++i) { writer.append(i); }
+    for (auto& reader : readers) { reader.join(); }
+    for (const auto sum : sums) { REQUIRE(sum == 999 * 1000 / 2); }
+    REQUIRE(snapshot.size() == 1000);
+    REQUIRE(writer.size() == 21000);
+}
+
+TEST_CASE("concurrent appender", "[pyvec]") {
+    constexpr int threads    = 8;
+    constexpr int per_thread = 10000;
+    pyvec<int>    list{-1};
+
+    std::vector<pyvec<int>::concurrent_appender> appenders;
+    for (int t = 0; t < threads; ++t) { appenders.push_back(list.appender(256)); }
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([&appender = appenders[t], t] {
+            for (int i = 0; i < per_thread; ++i) { appender.push_back(t * per_thread + i); }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    appenders.clear();   // publishes the partly filled tails
+
+    REQUIRE(list.size() == threads * per_thread + 1);
+    REQUIRE(list[0] == -1);
+    auto values = list.collect();
+    std::sort(values.begin(), values.end());
+    std::vector<int> expected(threads * per_thread + 1);
+    std::iota(expected.begin(), expected.end(), -1);
+    REQUIRE(values == expected);
+
+    // every producer keeps its own order
+    std::vector<int> last(threads, -1);
+    bool             ordered = true;
+    for (size_t i = 1; i < list.size(); ++i) {
+        const int t = list[i] / per_thread;
+        ordered &= list[i] > last[t];
+        last[t] = list[i];
+    }
+    REQUIRE(ordered);
+
+    SECTION("flush without destruction") {
+        auto appender = list.appender(100);
+        appender.emplace_back(7);
+        REQUIRE(list.size() == threads * per_thread + 1);
+        appender.flush();
+        REQUIRE(list.back() == 7);
+        // the unused slots of the flushed chunk are taken by ordinary appends
+        const auto capacity = list.capacity();
+        list.append(8);
+        REQUIRE(list.capacity() == capacity);
+    }
+}
+
+TEST_CASE("parallel filter and map", "[pyvec]") {
+    std::vector<int> data(50000);
+    for (int i = 0; i < 50000; ++i) { data[i] = (i * 7919) % 50000; }
+    pyvec<int> list(data.begin(), data.end());
+    auto       is_odd = [](const int x) { return x % 3 == 1; };
+
+    SECTION("filter keeps serial order") {
+        auto serial = list.deepcopy();
+        serial.filter(is_odd);
+        auto parallel = list.copy();
+        parallel.filter_parallel(is_odd, 4);
+        REQUIRE(parallel == serial);
+        REQUIRE(&parallel[0] == &*std::find_if(list.begin(), list.end(), is_odd));
+
+        auto shared = list.copy();
+        shared.filter_shared_parallel([](const std::shared_ptr<int>& x) { return *x % 3 == 1; }, 4);
+        REQUIRE(shared == serial);
+
+        auto all = list.copy();
+        all.filter_parallel([](int) { return true; }, 4);
+        REQUIRE(all == list);
+        all.filter_parallel([](int) { return false; });
+        REQUIRE(all.empty());
+    }
+
+    SECTION("exceptions leave the table untouched") {
+        auto copy = list.copy();
+        REQUIRE_THROWS_AS(
+            copy.filter_parallel(
+                [](const int x) {
+                    if (x == 123) { throw std::runtime_error("bad record"); }
+                    return true;
+                },
+                4
+            ),
+            std::runtime_error
+        );
+        REQUIRE(copy == list);
+    }
+
+    SECTION("map") {
+        auto strings = list.map([](const int x) { return std::to_string(x); });
+        static_assert(std::is_same_v<decltype(strings), pyvec<std::string>>);
+        REQUIRE(strings.size() == list.size());
+        REQUIRE(strings[10] == std::to_string(list[10]));
+
+        auto doubled = list.map_parallel([](const int x) { return 2.0 * x; }, 4);
+        REQUIRE(doubled.size() == list.size());
+        REQUIRE(doubled.is_dense());
+        bool same = true;
+        for (size_t i = 0; i < list.size(); ++i) { same &= doubled[i] == 2.0 * list[i]; }
+        REQUIRE(same);
+
+        struct boxed {
+            explicit boxed(int v) : value(v) {}
+            int value;
+        };
+        auto boxes = list.map_parallel([](const int x) { return boxed(x); }, 4);
+        REQUIRE(boxes.size() == list.size());
+        REQUIRE(boxes[49999].value == list[49999]);
+        REQUIRE(boxes[0].value == list[0]);
+    }
+}
+
+TEST_CASE("lazy views", "[pyvec]") {
+    pyvec<int> list{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    static_assert(std::ranges::random_access_range<pyvec_view<int>>);
+    static_assert(std::ranges::view<pyvec_view<int>>);
+    static_assert(std::ranges::sized_range<pyvec<int>::const_view_type>);
+
+    pyvec_view<int> all = list.view();
+    REQUIRE(all.size() == 10);
+    REQUIRE(std::ranges::equal(all, list.collect()));
+
+    auto strided = list.view({8, 1, -3});
+    REQUIRE(std::ranges::equal(strided, std::vector<int>{8, 5, 2}));
+    REQUIRE(strided[1] == 5);
+    REQUIRE(strided.back() == 2);
+    REQUIRE(&strided.front() == &list[8]);
+    REQUIRE(std::ranges::equal(list.view({nullopt, nullopt, -1}) | std::views::take(2), std::vector<int>{9, 8}));
+    REQUIRE(list.view({5, 5, 1}).empty());
+
+    // writes through a view reach the pyvec
+    for (auto& x : list.view({0, nullopt, 2})) { x *= 10; }
+    REQUIRE(list.collect() == std::vector<int>{0, 1, 20, 3, 40, 5, 60, 7, 80, 9});
+
+    auto pipeline = list.view({1, nullopt, 1}) | std::views::filter([](int x) { return x % 2 == 1; })
+                    | std::views::transform([](int x) { return x * x; });
+    REQUIRE(std::ranges::equal(pipeline, std::vector<int>{1, 9, 25, 49, 81}));
+
+    auto materialized = list.view({2, 8, 2}).materialize();
+    REQUIRE(materialized.collect() == std::vector<int>{20, 40, 60});
+    REQUIRE(&materialized[0] == &list[2]);
+    REQUIRE(materialized == list.getitem({2, 8, 2}));
+    REQUIRE(list.view({0, 3, 1}).materialize().is_dense());
+
+    const auto& constant = list;
+    auto        readonly = constant.view({0, 2, 1});
+    static_assert(std::is_same_v<decltype(*readonly.begin()), const int&>);
+    REQUIRE(std::ranges::equal(readonly, std::vector<int>{0, 1}));
+}
+
+TEST_CASE("in-place slice edits", "[pyvec]") {
+    using opt = std::optional<ptrdiff_t>;
+    const std::vector<std::array<opt, 3>> slices{
+        {opt{}, opt{}, opt{}},  {2, 5, opt{}},  {opt{}, opt{}, 2}, {1, 17, 3},  {-3, opt{}, opt{}},
+        {opt{}, opt{}, -1},     {15, 2, -4},    {5, 5, 2},         {19, 0, -7}, {-1, -2, opt{}},
+        {opt{}, 1, -3},         {0, 20, 19},
+    };
+    std::vector<int> base(20);
+    std::iota(base.begin(), base.end(), 0);
+
+    for (const auto& [start, stop, step] : slices) {
+        const slice cut(start, stop, step);
+        pyvec<int>  indices(base.begin(), base.end());
+        const auto  removed = indices.getitem(cut).collect();
+
+        pyvec<int> list(base.begin(), base.end());
+        list.delitem(cut);
+        std::vector<int> expected;
+        for (const int x : base) {
+            if (std::find(removed.begin(), removed.end(), x) == removed.end()) { expected.push_back(x); }
+        }
+        REQUIRE(list.collect() == expected);
+
+        // same length replacement keeps every other position
+        pyvec<int>       replaced(base.begin(), base.end());
+        std::vector<int> values(removed.size());
+        std::iota(values.begin(), values.end(), 100);
+        replaced.setitem(cut, values.begin(), values.end());
+        expected = base;
+        for (size_t i = 0; i < removed.size(); ++i) { expected[removed[i]] = values[i]; }
+        REQUIRE(replaced.collect() == expected);
+    }
+
+    SECTION("contiguous resize") {
+        pyvec<int>             list(base.begin(), base.end());
+        const std::vector<int> longer{-1, -2, -3, -4, -5};
+        list.setitem({2, 4, 1}, longer.begin(), longer.end());
+        REQUIRE(list.size() == 23);
+        REQUIRE(list[6] == -5);
+        REQUIRE(list[7] == 4);
+        list.setitem({0, 10, 1}, longer.begin(), longer.begin() + 1);
+        REQUIRE(list.size() == 14);
+        REQUIRE(list[0] == -1);
+        REQUIRE(list[1] == 7);
+    }
+
+    SECTION("empty assignments") {
+        pyvec<int>             list(base.begin(), base.end());
+        const std::vector<int> none;
+        list.setitem({0, 5, 1}, none.begin(), none.end());
+        REQUIRE(list.size() == 15);
+        REQUIRE(list[0] == 5);
+        list.setitem({3, 3, 2}, none.begin(), none.end());
+        REQUIRE(list.size() == 15);
+        REQUIRE_THROWS_AS(list.setitem({0, 6, 2}, none.begin(), none.end()), std::invalid_argument);
+        REQUIRE(list.size() == 15);
+    }
+}
+
+TEST_CASE("front and middle edits", "[pyvec]") {
+    pyvec<int>       list;
+    std::vector<int> expected;
+    // positions alternate between both ends and the middle so either side gets shifted
+    for (int i = 0; i < 3000; ++i) {
+        const size_t n   = expected.size();
+        const size_t pos = i % 3 == 0 ? 0 : i % 3 == 1 ? n : (static_cast<size_t>(i) * 7919) % (n + 1);
+        list.insert(list.cbegin() + static_cast<ptrdiff_t>(pos), i);
+        expected.insert(expected.begin() + static_cast<ptrdiff_t>(pos), i);
+        if (i % 5 == 4) {
+            const size_t gone = (static_cast<size_t>(i) * 104729) % expected.size();
+            list.erase(list.cbegin() + static_cast<ptrdiff_t>(gone));
+            expected.erase(expected.begin() + static_cast<ptrdiff_t>(gone));
+        }
+    }
+    REQUIRE(list.collect() == expected);
+
+    // erasing a prefix moves the table start instead of the tail
+    list.erase(list.cbegin(), list.cbegin() + 10);
+    expected.erase(expected.begin(), expected.begin() + 10);
+    REQUIRE(list.collect() == expected);
+    REQUIRE(std::equal(list.pbegin(), list.pend(), list.begin(), list.end(), [](const int* ptr, const int& x) {
+        return ptr == &x;
+    }));
+
+    SECTION("work queue") {
+        pyvec<int> queue;
+        for (int i = 0; i < 100; ++i) { queue.append(i); }
+        for (int i = 100; i < 20000; ++i) {
+            REQUIRE(*queue.pop(0) == i - 100);
+            queue.append(i);
+        }
+        REQUIRE(queue.size() == 100);
+        REQUIRE(queue[0] == 19900);
+        REQUIRE(queue[99] == 19999);
+    }
+}
+
+TEST_CASE("deque ends", "[pyvec]") {
+    pyvec<int> list;
+    REQUIRE_THROWS_AS(list.popleft(), std::out_of_range);
+    for (int i = 0; i < 1000; ++i) { list.appendleft(i); }
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list[0] == 999);
+    REQUIRE(list[999] == 0);
+    REQUIRE(list.pbegin()[1] == &list[1]);
+
+    // alternating ends keep the size fixed while the table start wanders
+    for (int i = 0; i < 5000; ++i) {
+        if (i % 2 == 0) {
+            list.append(*list.popleft());
+        } else {
+            list.appendleft(*list.pop());
+        }
+    }
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list[0] == 999);
+    REQUIRE(list[999] == 0);
+
+    pyvec<int> rotated;
+    for (int i = 0; i < 50; ++i) { rotated.append(i); }
+    for (int i = 0; i < 20; ++i) { rotated.append(rotated.popleft()); }
+    REQUIRE(rotated[0] == 20);
+    REQUIRE(rotated[49] == 19);
+
+    // a popped handle outlives its slot in the table
+    const auto head = rotated.popleft();
+    rotated.appendleft(head);
+    REQUIRE(*head == 20);
+    REQUIRE(rotated[0] == 20);
+    REQUIRE(rotated.size() == 50);
+}
+
+TEST_CASE("storage stats", "[pyvec]") {
+    pyvec<int> list;
+    auto       stats = list.stats();
+    REQUIRE(stats.chunks == 0);
+    REQUIRE(stats.live == 0);
+    REQUIRE(stats.storage_use_count == 0);
+    REQUIRE(stats.locality == 1);
+
+    for (int i = 0; i < 1000; ++i) { list.append(i); }
+    stats = list.stats();
+    REQUIRE(stats.live == 1000);
+    REQUIRE(stats.used == 1000);
+    REQUIRE(stats.capacity == list.capacity());
+    REQUIRE(stats.chunk_allocations == 0);   // only counted with PYVEC_COUNTERS
+    REQUIRE(stats.fragmentation == 0);
+    REQUIRE(stats.table_bytes >= 1000 * sizeof(int*));
+    REQUIRE(stats.storage_use_count == 1);
+    // only the chunk boundaries break the runs
+    REQUIRE(stats.locality > 0.99);
+
+    list.filter([](const int x) { return x % 4 == 0; });
+    {
+        const auto copy = list.copy();
+        stats           = list.stats();
+        REQUIRE(stats.live == 250);
+        REQUIRE(stats.used == 1000);
+        REQUIRE(stats.fragmentation == 0.75);
+        REQUIRE(stats.locality == 0);
+        REQUIRE(stats.storage_use_count == 2);
+    }
+
+    REQUIRE(list.compact());
+    stats = list.stats();
+    REQUIRE(stats.chunks == 1);
+    REQUIRE(stats.used == 250);
+    REQUIRE(stats.fragmentation == 0);
+    REQUIRE(stats.locality == 1);
+}
+
+TEST_CASE("save and load", "[pyvec]") {
+    pyvec<int> list;
+    for (int i = 0; i < 1000; ++i) { list.append(i); }
+    list.insert(list.cbegin() + 10, 3, -1);
+    list.filter([](const int x) { return x % 3 != 0; });
+    REQUIRE_FALSE(list.is_dense());
+
+    std::stringstream buffer;
+    list.save(buffer);
+    const auto loaded = pyvec<int>::load(buffer);
+    REQUIRE(loaded.collect() == list.collect());
+    REQUIRE(loaded.is_dense());
+
+    std::stringstream wrong;
+    list.save(wrong);
+    REQUIRE_THROWS_AS(pyvec<double>::load(wrong), std::runtime_error);
+    std::stringstream garbage("definitely not a pyvec file, but long enough for a header.........");
+    REQUIRE_THROWS_AS(pyvec<int>::load(garbage), std::runtime_error);
+
+    // a count the payload does not back is reported, not allocated
+    detail::file_header header;
+    header.element_size = sizeof(int);
+    header.count        = uint64_t{1} << 62;
+    std::stringstream huge;
+    huge.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    huge << "a few bytes";
+    REQUIRE_THROWS_AS(pyvec<int>::load(huge), std::runtime_error);
+    // a stream that cannot be measured is read block by block
+    struct unseekable : std::streambuf {
+        explicit unseekable(std::string& bytes) {
+            setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+        }
+    };
+    std::string  huge_bytes = huge.str();
+    unseekable   huge_pipe(huge_bytes);
+    std::istream huge_stream(&huge_pipe);
+    REQUIRE_THROWS_AS(pyvec<int>::load(huge_stream), std::runtime_error);
+    std::stringstream saved;
+    list.save(saved);
+    std::string  saved_bytes = saved.str();
+    unseekable   saved_pipe(saved_bytes);
+    std::istream saved_stream(&saved_pipe);
+    REQUIRE(pyvec<int>::load(saved_stream).collect() == list.collect());
+
+    const auto path = (std::filesystem::temp_directory_path() /
+                       ("pyvec_save_test_" + std::to_string(std::random_device{}()) + ".bin"))
+                          .string();
+    list.save(path);
+    REQUIRE(pyvec<int>::load(path).collect() == list.collect());
+
+    SECTION("mapped file") {
+        auto mapped = pyvec<int>::map_file(path);
+        REQUIRE(mapped.collect() == list.collect());
+        REQUIRE(mapped.is_dense());
+
+        // writes go to private pages, the file keeps its contents
+        mapped[0] = 42;
+        mapped.append(7);
+        mapped.insert(0, 8);
+        REQUIRE(mapped[0] == 8);
+        REQUIRE(mapped[1] == 42);
+        REQUIRE(mapped[mapped.size() - 1] == 7);
+        REQUIRE(pyvec<int>::load(path)[0] == list[0]);
+
+        // handles keep the mapping alive after the list is gone
+        const auto handle = mapped.getitem(1);
+        mapped.clear();
+        REQUIRE(*handle == 42);
+
+        auto compacted = pyvec<int>::map_file(path);
+        REQUIRE(compacted.compact());
+        REQUIRE(compacted.collect() == list.collect());
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("external buffers", "[pyvec]") {
+    auto buffer = std::make_unique<int[]>(100);
+    std::iota(buffer.get(), buffer.get() + 100, 0);
+    const int* raw = buffer.get();
+
+    pyvec<int> list(std::move(buffer), 100);
+    REQUIRE(list.size() == 100);
+    REQUIRE(&list[0] == raw);
+    REQUIRE(list.as_span().data() == raw);
+    REQUIRE(list.capacity() == 0);
+
+    // a span with a keep-alive, like a buffer handed over from python
+    auto       external = std::make_shared<std::vector<int>>(50, 7);
+    const auto released = std::weak_ptr<std::vector<int>>(external);
+    list.extend(std::span<int>(*external), external);
+    external.reset();
+    REQUIRE_FALSE(released.expired());
+    REQUIRE(list.size() == 150);
+    REQUIRE(list[149] == 7);
+    REQUIRE_FALSE(list.is_dense());
+    REQUIRE_THROWS_AS(list.as_span(), std::logic_error);
+
+    {
+        // handles keep the adopted memory alive on their own
+        const auto handle = list.getitem(120);
+        list.clear();
+        REQUIRE_FALSE(released.expired());
+        REQUIRE(*handle == 7);
+    }
+    REQUIRE(released.expired());
+    REQUIRE(list.as_span().empty());
+
+    // writes through the span land in the shared elements
+    pyvec<int> dense{1, 2, 3};
+    auto       copy = dense.copy();
+    dense.as_span()[1] = 20;
+    REQUIRE(copy[1] == 20);
+    const auto& view = dense;
+    REQUIRE(view.as_span().size() == 3);
+}
+
+TEST_CASE("borrowed handles", "[pyvec]") {
+    pyvec<int> list;
+    for (int i = 0; i < 100; ++i) { list.append(i); }
+
+    // borrowing leaves the storage's reference count alone
+    const auto use_count = list.stats().storage_use_count;
+    auto       borrowed  = list.borrow(-1);
+    REQUIRE(*borrowed == 99);
+    REQUIRE(list.stats().storage_use_count == use_count);
+    std::shared_ptr<int> escaped = borrowed;
+    REQUIRE(list.stats().storage_use_count == use_count + 1);
+    REQUIRE(escaped.get() == borrowed.get());
+    REQUIRE(pyvec<int>::ref() == pyvec<int>::ref());
+    REQUIRE_FALSE(pyvec<int>::ref().share());
+
+    list.filter_shared([&](const pyvec<int>::ref& x) {
+        REQUIRE(list.stats().storage_use_count == use_count + 1);
+        return *x % 2 == 0;
+    });
+    REQUIRE(list.size() == 50);
+    list.sort_shared([](const auto& x) { return -*x; }, false);
+    REQUIRE(list[0] == 98);
+    REQUIRE(list.is_sorted_shared([](const auto& x) { return -*x; }, false));
+
+    // callbacks written against shared_ptr keep working
+    list.filter_shared([](const std::shared_ptr<int>& x) { return *x > 10; });
+    REQUIRE(list.size() == 44);
+
+    // the borrowed iterator hands out refs, the shared one owning handles
+    long sum = 0;
+    for (auto it = list.bbegin(); it != list.bend(); ++it) {
+        const pyvec<int>::ref x = *it;
+        sum += *x;
+    }
+    REQUIRE(sum == std::accumulate(list.begin(), list.end(), 0L));
+    REQUIRE(list.stats().storage_use_count == use_count + 1);
+    std::vector<std::shared_ptr<int>> kept;
+    for (auto it = list.sbegin(); it != list.send(); ++it) {
+        auto handle = *it;   // owning, like getitem
+        kept.push_back(handle);
+    }
+    list.clear();
+    REQUIRE(*kept.front() == 98);
+    REQUIRE(*kept.back() == 12);
+    REQUIRE(*escaped == 99);
+}
+
+TEST_CASE("sortedness tracking", "[pyvec]") {
+    pyvec<int> list;
+    REQUIRE_FALSE(list.assume_sorted());
+    list.set_assume_sorted(true);
+    for (int i = 0; i < 100; ++i) { list.append(i / 2); }
+    // appends in order keep the list known to be sorted
+    const auto& view = list;
+    REQUIRE(view.is_sorted());
+    REQUIRE(view.bisect_left(10) == 20);
+    REQUIRE(view.bisect_right(10) == 22);
+    REQUIRE(view.index(10) == 20);
+    REQUIRE(view.count(10) == 2);
+    REQUIRE(view.count(100) == 0);
+    REQUIRE_FALSE(view.contains(-1));
+
+    list.insort(10);
+    list.insort(-5);
+    list.insort(200);
+    REQUIRE(list.size() == 103);
+    REQUIRE(view.count(10) == 3);
+    REQUIRE(view[0] == -5);
+    REQUIRE(view[103 - 1] == 200);
+    list.remove(10);
+    REQUIRE(view.count(10) == 2);
+    REQUIRE(std::is_sorted(view.begin(), view.end()));
+
+    // writes are noticed, and the next check or sort finds the order again
+    list[0] = 1000;
+    REQUIRE_FALSE(view.is_sorted());
+    REQUIRE(view.count(1000) == 1);
+    list.sort();
+    REQUIRE(view[101] == 1000);
+    REQUIRE(view.index(49) == 98);
+    list.append(-1);
+    REQUIRE_FALSE(view.is_sorted());
+    list.pop();
+    REQUIRE(view.is_sorted());
+
+    // stable merge of two sorted lists, and of unsorted ones
+    pyvec<int> other{-3, 10, 10, 2000};
+    list.merge(other);
+    REQUIRE(list.size() == 106);
+    REQUIRE(view.front() == -3);
+    REQUIRE(view[1] == 0);
+    REQUIRE(view.back() == 2000);
+    REQUIRE(std::is_sorted(view.begin(), view.end()));
+    REQUIRE(view.count(10) == 4);
+    pyvec<int> unsorted{5, 1, 3};
+    unsorted.merge(pyvec<int>{4, 2});
+    REQUIRE(unsorted == pyvec<int>{1, 2, 3, 4, 5});
+
+    struct item {
+        int key, tag;
+        bool operator<(const item& other) const { return key < other.key; }
+        bool operator==(const item& other) const { return key == other.key && tag == other.tag; }
+    };
+    pyvec<item> items{{1, 0}, {2, 0}, {2, 1}, {3, 0}};
+    items.set_assume_sorted(true);
+    items.sort();
+    items.merge(pyvec<item>{{2, 2}});
+    REQUIRE(items[3].tag == 2);
+    // equivalent but unequal neighbours leave the order unknown, lookups scan
+    const auto& items_view = items;
+    REQUIRE(items_view.index(item{2, 1}) == 2);
+    REQUIRE(items_view.count(item{2, 0}) == 1);
+    REQUIRE_FALSE(items_view.contains(item{2, 3}));
+
+    SECTION("unordered values break the order") {
+        pyvec<double> values;
+        values.set_assume_sorted(true);
+        values.append(1.0);
+        values.append(NAN);
+        values.append(0.5);
+        const auto& values_view = values;
+        REQUIRE(values_view.count(0.5) == 1);
+        REQUIRE(values_view.contains(0.5));
+        REQUIRE(values_view.index(0.5) == 2);
+        values.sort();
+        REQUIRE(values_view.contains(0.5));
+        REQUIRE(values_view.contains(1.0));
+        values.insort(NAN);
+        values.insort(0.75);
+        REQUIRE(values_view.count(0.75) == 1);
+        pyvec<double> nans;
+        nans.assign(3, static_cast<double>(NAN));
+        nans.append(0.0);
+        REQUIRE(std::as_const(nans).count(0.0) == 1);
+    }
+
+    SECTION("writes through a copy sharing the elements are seen") {
+        pyvec<int> b{3, 1, 2};
+        b.set_assume_sorted(true);
+        b.sort();
+        auto c = b.copy();
+        c[0]   = 100;
+        REQUIRE(std::as_const(b).contains(100));
+        REQUIRE(std::as_const(b).count(100) == 1);
+        b.sort();
+        c[1] = -7;
+        REQUIRE(std::as_const(b).index(-7) == 0);
+        auto s = b.getitem(slice(0, 2));
+        s[0]   = 42;
+        REQUIRE(std::as_const(b).contains(42));
+        REQUIRE_FALSE(b.is_sorted());
+    }
+
+    SECTION("without the opt-in, writes through earlier references are seen") {
+        pyvec<int> v{5, 1, 3, 2, 4};
+        int&       r = v[4];
+        v.sort();
+        r              = 100;
+        const auto& cv = v;
+        REQUIRE(cv.contains(100));
+        REQUIRE(cv.count(100) == 1);
+        REQUIRE(cv.index(100) == 3);
+        REQUIRE_FALSE(cv.is_sorted());
+        v.sort();
+        REQUIRE(cv.back() == 100);
+        v.remove(100);
+        REQUIRE(v.collect() == std::vector<int>{1, 2, 3, 5});
+    }
+}
+
+TEST_CASE("hash index", "[pyvec]") {
+    pyvec<int> list;
+    list.set_hash_index(true);
+    REQUIRE(list.hash_index());
+    std::vector<int> expected;
+    const auto&      view  = list;
+    const auto       check = [&] {
+        REQUIRE(view.size() == expected.size());
+        for (int v = -2; v < 40; ++v) {
+            const auto count = static_cast<size_t>(std::count(expected.begin(), expected.end(), v));
+            REQUIRE(view.count(v) == count);
+            REQUIRE(view.contains(v) == (count != 0));
+            if (count != 0) {
+                const auto first = std::find(expected.begin(), expected.end(), v);
+                REQUIRE(view.index(v) == static_cast<size_t>(first - expected.begin()));
+            } else {
+                REQUIRE_THROWS_AS(view.index(v), std::invalid_argument);
+            }
+        }
+    };
+
+    // appends, pops and single edits keep the index up to date
+    for (int i = 0; i < 100; ++i) {
+        list.append(i % 30);
+        expected.push_back(i % 30);
+    }
+    check();
+    list.pop();
+    expected.pop_back();
+    list.insert(5, 35);
+    expected.insert(expected.begin() + 5, 35);
+    list.setitem(0, 36);
+    expected[0] = 36;
+    check();
+    list.remove(7);
+    expected.erase(std::find(expected.begin(), expected.end(), 7));
+    list.delitem(-1);
+    expected.pop_back();
+    list.popleft();
+    expected.erase(expected.begin());
+    check();
+    REQUIRE(view.index(1, 10) == 30);
+
+    // bulk changes are picked up by the next lookup
+    list.sort();
+    std::sort(expected.begin(), expected.end());
+    check();
+    list.filter([](const int x) { return x % 3 != 0; });
+    std::erase_if(expected, [](const int x) { return x % 3 == 0; });
+    check();
+    list.setitem(0, -1);
+    expected[0] = -1;
+    list.extend({5, 5, 5});
+    expected.insert(expected.end(), {5, 5, 5});
+    check();
+    list.reverse();
+    std::reverse(expected.begin(), expected.end());
+    check();
+
+    // writes through references handed out are picked up by the next lookup
+    list.emplace_back(37) = 38;
+    REQUIRE(view.count(37) == 0);
+    REQUIRE(view.count(38) == 1);
+    list.pop();
+    {
+        pyvec<int> small{1, 2, 3};
+        small.set_hash_index(true);
+        REQUIRE(std::as_const(small).contains(2));
+        small[1] = 7;
+        REQUIRE(std::as_const(small).contains(7));
+        REQUIRE_FALSE(std::as_const(small).contains(2));
+        small.remove(7);
+        REQUIRE(small.collect() == std::vector<int>{1, 3});
+        *small.begin() = 4;
+        REQUIRE(std::as_const(small).index(4) == 0);
+    }
+
+    // const lookups from several threads share the rebuild
+    list.sort();
+    std::sort(expected.begin(), expected.end());
+    {
+        std::vector<std::thread> readers;
+        std::vector<size_t>      found(4);
+        for (size_t t = 0; t < found.size(); ++t) {
+            readers.emplace_back([&, t] {
+                for (int v = 0; v < 40; ++v) { found[t] += view.count(v) + view.contains(v); }
+            });
+        }
+        for (auto& reader : readers) { reader.join(); }
+        size_t total = 0;
+        for (int v = 0; v < 40; ++v) {
+            const auto count = static_cast<size_t>(std::count(expected.begin(), expected.end(), v));
+            total += count + (count != 0);
+        }
+        for (const auto n : found) { REQUIRE(n == total); }
+    }
+    check();
+
+    // moves take the index along, clear empties it
+    pyvec<int> moved = std::move(list);
+    REQUIRE(moved.hash_index());
+    const auto fives = static_cast<size_t>(std::count(expected.begin(), expected.end(), 5));
+    REQUIRE(std::as_const(moved).count(5) == fives);
+    moved.clear();
+    REQUIRE_FALSE(std::as_const(moved).contains(5));
+    moved.set_hash_index(false);
+    REQUIRE_FALSE(moved.hash_index());
+}
+
+namespace {
+// eagerly started coroutine that nobody waits for
+struct detached {
+    struct promise_type {
+        detached            get_return_object() { return {}; }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { std::terminate(); }
+    };
+};
+
+detached sum_batches(pyvec_stream<int>& stream, long long& sum, size_t& batches) {
+    while (auto batch = co_await stream.next()) {
+        for (const auto x : batch->as_span()) { sum += x; }
+        ++batches;
+    }
+}
+
+// eagerly started coroutine destroyed with its owner, suspended or not
+struct owned {
+    struct promise_type {
+        owned get_return_object() {
+            return owned(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { std::terminate(); }
+    };
+
+    explicit owned(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    owned(owned&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    ~owned() {
+        if (handle) { handle.destroy(); }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// the co_await stays out of the loop condition, where GCC 12 mishandles destroying a
+// coroutine suspended in it
+owned count_batches(pyvec_stream<int>& stream, size_t& batches) {
+    for (;;) {
+        const auto batch = co_await stream.next();
+        if (!batch) { break; }
+        ++batches;
+    }
+}
+}   // namespace
+
+TEST_CASE("streaming batches", "[pyvec_stream]") {
+    {
+        // at most two batches in flight, the producer waits for the consumer
+        pyvec_stream<int> stream(100, 2);
+        std::thread       producer([&] {
+            for (int i = 0; i < 10000; ++i) { stream.append(i); }
+            stream.append(-1);
+            stream.close();
+        });
+        long long sum = 0;
+        size_t    n   = 0;
+        while (auto batch = stream.pop()) {
+            // every batch sits in one chunk of its own
+            REQUIRE(batch->is_dense());
+            REQUIRE(batch->capacity() == 100);
+            REQUIRE(stream.ready() <= 2);
+            for (const auto x : batch->as_span()) { sum += x; }
+            n += batch->size();
+        }
+        producer.join();
+        REQUIRE(n == 10001);
+        REQUIRE(sum == 49995000 - 1);
+        REQUIRE(stream.closed());
+        REQUIRE_FALSE(stream.try_pop());
+    }
+    {
+        pyvec_stream<int> stream(4);
+        stream.append(1);
+        REQUIRE_FALSE(stream.try_pop());
+        stream.flush();
+        auto batch = stream.try_pop();
+        REQUIRE(batch);
+        REQUIRE(batch->size() == 1);
+
+        // elements keep their address and outlive the stream through handles
+        const auto handle = batch->getitem(0);
+        const int* raw    = handle.get();
+        for (int i = 0; i < 8; ++i) { stream.append(i); }
+        batch.reset();
+        REQUIRE(*handle == 1);
+        REQUIRE(handle.get() == raw);
+        REQUIRE(stream.ready() == 2);
+    }
+    {
+        // a suspended consumer is resumed by the producer with the batch
+        pyvec_stream<int> stream(10);
+        long long         sum     = 0;
+        size_t            batches = 0;
+        sum_batches(stream, sum, batches);
+        REQUIRE(batches == 0);
+        for (int i = 0; i < 25; ++i) { stream.append(i); }
+        REQUIRE(batches == 2);
+        REQUIRE(stream.ready() == 0);
+        stream.close();
+        REQUIRE(batches == 3);
+        REQUIRE(sum == 300);
+    }
+    {
+        // a consumer destroyed while suspended is not resumed, the next one gets the batch
+        pyvec_stream<int> stream(2);
+        size_t               dropped = 0;
+        size_t               kept    = 0;
+        std::optional<owned> gone(count_batches(stream, dropped));
+        const owned          consumer(count_batches(stream, kept));
+        gone.reset();
+        for (int i = 0; i < 4; ++i) { stream.append(i); }
+        REQUIRE(dropped == 0);
+        REQUIRE(kept == 2);
+        stream.close();
+        REQUIRE(consumer.handle.done());
+    }
+}
+
+namespace {
+struct event {
+    int64_t  ts  = 0;
+    float    val = 0;
+    uint32_t id  = 0;
+};
+}   // namespace
+
+TEST_CASE("structure of arrays", "[pyvec_soa]") {
+    using events = pyvec_soa<event, &event::ts, &event::val, &event::id>;
+    events list;
+    for (int i = 0; i < 1000; ++i) {
+        list.append({1000 - i, static_cast<float>(i % 10), static_cast<uint32_t>(i)});
+    }
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list[3].ts == 997);
+    REQUIRE(list.getitem(-1).id == 999);
+
+    // column scans see one field in logical order
+    const auto val = list.column<&event::val>();
+    REQUIRE(val.size() == 1000);
+    REQUIRE(std::accumulate(val.begin(), val.end(), 0.0) == 4500.0);
+    list.field<&event::val>(0) = 3;
+    REQUIRE(list[0].val == 3);
+    REQUIRE(val[0] == 3);
+
+    // slices share the columns and keep their order
+    auto tail = list.getitem(slice(-3, nullopt));
+    REQUIRE(tail.size() == 3);
+    REQUIRE(tail.is_dense());
+    REQUIRE(tail.column<&event::id>()[0] == 997);
+    auto odd = list.getitem(slice(1, nullopt, 2));
+    REQUIRE(odd[1].id == 3);
+    REQUIRE_FALSE(odd.is_dense());
+    REQUIRE_THROWS_AS(odd.column<&event::id>(), std::logic_error);
+
+    list.filter_by<&event::val>([](const float v) { return v < 5; });
+    REQUIRE(list.size() == 500);
+    size_t runs = 0, total = 0;
+    list.for_each_span<&event::id>([&](std::span<uint32_t> ids) {
+        REQUIRE(ids[0] % 10 == 0);
+        ++runs;
+        total += ids.size();
+    });
+    REQUIRE(runs == 100);
+    REQUIRE(total == 500);
+
+    // sort by a field, or by a key on the whole element
+    list.sort_by<&event::ts>();
+    REQUIRE(list[0].ts == 6);
+    REQUIRE(list[499].ts == 1000);
+    list.sort([](const event& e) { return e.id % 7; }, true);
+    REQUIRE(list[0].id % 7 == 6);
+    REQUIRE(list[499].id % 7 == 0);
+
+    list.relayout();
+    REQUIRE(list.is_dense());
+    REQUIRE(list.column<&event::ts>().size() == 500);
+    REQUIRE(odd[1].id == 3);
+
+    list.insert(0, {-1, 0.5, 7});
+    list.setitem(1, {-2, 1.5, 8});
+    REQUIRE(list.pop(0).ts == -1);
+    REQUIRE(list[0].val == 1.5f);
+    list.delitem(0);
+    REQUIRE(list.size() == 499);
+    REQUIRE(list.collect().size() == 499);
+
+    // copies are deep like pyvec's, copy() shares the columns
+    auto deep = list;
+    deep.field<&event::ts>(0) = 9;
+    REQUIRE(list[0].ts != 9);
+    REQUIRE(deep.is_dense());
+    auto shallow = list.copy();
+    shallow.field<&event::ts>(0) = 9;
+    REQUIRE(list[0].ts == 9);
+    deep = shallow;
+    REQUIRE(deep.collect().size() == shallow.size());
+
+    // growing a shared instance leaves the columns the others see in place
+    const auto ts = list.column<&event::ts>();
+    for (int i = 0; i < 1000; ++i) { shallow.append({i, 0, 0}); }
+    REQUIRE(ts.data() == list.column<&event::ts>().data());
+    REQUIRE(ts[0] == 9);
+    shallow.field<&event::ts>(0) = 10;
+    REQUIRE(list[0].ts == 9);
+    REQUIRE(shallow.size() == 1499);
+
+    // fields that are not listed are not kept
+    pyvec_soa<event, &event::id> ids{{1, 2, 3}, {4, 5, 6}};
+    REQUIRE(ids[1].id == 6);
+    REQUIRE(ids[1].ts == 0);
+
+    // clear releases the columns unless a copy still shares them
+    struct owner {
+        std::shared_ptr<int> ptr;
+    };
+    const auto                    tracked = std::make_shared<int>(1);
+    pyvec_soa<owner, &owner::ptr> owners{{tracked}, {tracked}};
+    REQUIRE(tracked.use_count() == 3);
+    auto kept = owners.copy();
+    owners.clear();
+    REQUIRE(tracked.use_count() == 3);
+    kept.clear();
+    REQUIRE(tracked.use_count() == 1);
+    owners.append({tracked});
+    REQUIRE(owners.column<&owner::ptr>()[0] == tracked);
+}
+
+TEST_CASE("compact row index", "[pyvec_soa]") {
+    using events = compact_pyvec_soa<event, &event::ts, &event::val>;
+    static_assert(sizeof(events::index_type) == 4);
+    events list;
+    for (int i = 0; i < 1000; ++i) { list.append({i % 100, static_cast<float>(i), 0}); }
+
+    // the same results as the full-width index, including the radix path of sort_by
+    list.sort_by<&event::ts>(true);
+    REQUIRE(list[0].ts == 99);
+    REQUIRE(list[0].val == 99);
+    REQUIRE(list[9].val == 999);
+    REQUIRE(list[999].ts == 0);
+    list.filter_by<&event::ts>([](const int64_t ts) { return ts == 0; });
+    REQUIRE(list.size() == 10);
+    list.relayout();
+    const auto val = list.column<&event::val>();
+    REQUIRE(std::accumulate(val.begin(), val.end(), 0.0) == 4500.0);
+}
+
+TEST_CASE("compact pyvec", "[compact_pyvec]") {
+    static_assert(sizeof(compact_pyvec<int64_t>::handle_type) == 4);
+    compact_pyvec<int64_t> list;
+    std::vector<int64_t>   expected;
+    // crosses the chunk boundaries at 64, 192, 448 and 960 slots
+    for (int64_t i = 0; i < 1000; ++i) {
+        list.append(i * 7 % 1000);
+        expected.push_back(i * 7 % 1000);
+    }
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list.capacity() == 64 + 128 + 256 + 512 + 1024);
+    REQUIRE(std::vector<int64_t>(list.begin(), list.end()) == expected);
+    REQUIRE(list[63] == expected[63]);
+    REQUIRE(list[64] == expected[64]);
+    REQUIRE(list.at(447) == expected[447]);
+    REQUIRE(list.at(448) == expected[448]);
+    REQUIRE(list.at(960) == expected[960]);
+    REQUIRE_THROWS_AS(list.at(1000), std::out_of_range);
+    const int64_t* first = &list[0];
+
+    // the handle table takes half the bytes of pyvec's pointer table
+    pyvec<int64_t> wide(expected.begin(), expected.end());
+    REQUIRE(list.memory_usage() - list.capacity() * sizeof(int64_t) <
+            wide.memory_usage() - wide.capacity() * sizeof(int64_t));
+
+    // reordering only rewrites the table, elements stay where they are
+    list.sort();
+    REQUIRE(std::is_sorted(list.begin(), list.end()));
+    REQUIRE(list.front() == 0);
+    REQUIRE(list.back() == 999);
+    REQUIRE(*std::min_element(list.begin(), list.end()) == *first);
+    list.sort([](const int64_t x) { return x % 10; }, true);
+    REQUIRE(list[0] % 10 == 9);
+    list.sort([](const int64_t x) { return std::to_string(x); }, false);
+    REQUIRE(list[0] == 0);
+    REQUIRE(list[1] == 1);
+    REQUIRE(list[2] == 10);
+    list.reverse();
+    REQUIRE(list[0] == 999);
+    std::sort(list.begin(), list.end());   // through the iterator, like std::vector
+    REQUIRE(list.index(500) == 500);
+    REQUIRE(list.count(500) == 1);
+    REQUIRE(list.contains(999));
+    REQUIRE_THROWS_AS(list.index(5, 10), std::invalid_argument);
+
+    // python edits
+    list.insert(0, -1);
+    list.setitem(1, -2);
+    REQUIRE(list[0] == -1);
+    REQUIRE(list[1] == -2);
+    REQUIRE(*list.pop(0) == -1);
+    list.remove(-2);
+    REQUIRE(list[0] == 1);
+    list.filter([](const int64_t x) { return x % 2 == 0; });
+    REQUIRE(list.size() == 499);
+    list.delitem(slice(nullopt, nullopt, 2));
+    REQUIRE(list.size() == 249);
+    REQUIRE(list[0] == 4);
+    REQUIRE(list[1] == 8);
+    list.delitem(slice(-10, nullopt));
+    REQUIRE(list.size() == 239);
+    list.delitem(0);
+    REQUIRE(list[0] == 8);
+
+    // slices and copy() share the elements, the copy constructor does not
+    auto shallow = list.copy();
+    auto odd     = list.getitem(slice(1, nullopt, 2));
+    auto deep    = list;
+    shallow[0]   = 100;
+    REQUIRE(list[0] == 100);
+    REQUIRE(deep[0] == 8);
+    odd[0] = 200;
+    REQUIRE(list[1] == 200);
+    REQUIRE(deep != list);
+    REQUIRE(list.deepcopy() == list);
+    const auto handle = list.getitem(0);
+    list.clear();
+    shallow.clear();
+    odd.clear();
+    REQUIRE(*handle == 100);
+
+    // moving out of a list nobody shares moves the elements
+    compact_pyvec<std::string> words{"a", "b"};
+    compact_pyvec<std::string> more{std::string(100, 'x')};
+    words.extend(std::move(more));
+    REQUIRE(words.size() == 3);
+    REQUIRE(words[2].size() == 100);
+    REQUIRE(more.empty());
+    words.extend(words);
+    const std::string long_word(100, 'x');
+    REQUIRE(words.collect() == std::vector<std::string>{"a", "b", long_word, "a", "b", long_word});
+}
+
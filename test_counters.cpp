@@ -0,0 +1,21 @@
+//
+// built with PYVEC_COUNTERS defined, see CMakeLists.txt
+//
+#include "pyvec.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+using namespace pycontainer;
+
+TEST_CASE("storage counters", "[pyvec]") {
+    pyvec<int> list;
+    for (int i = 0; i < 1000; ++i) { list.append(i); }
+    auto stats = list.stats();
+    REQUIRE(stats.chunks == stats.chunk_allocations);
+
+    list.filter([](const int x) { return x % 4 == 0; });
+    const auto allocations = stats.chunk_allocations;
+    REQUIRE(list.compact());
+    stats = list.stats();
+    REQUIRE(stats.chunks == 1);
+    REQUIRE(stats.chunk_allocations == allocations + 1);
+}